@@ -0,0 +1,320 @@
+/* Benchmark driver: times a suite of interpreter workloads and reports
+   ns/op over several repetitions.  Results can be saved as a
+   tab-separated file and compared against a saved baseline.
+   Usage: bench/bench [-r reps] [-o results.tsv] [-b baseline.tsv]
+                      [-t threshold-percent] [name-substring]
+   Run from the top of the source tree (it loads tuslrc.ts and eg/). */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tusl.h"
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static FILE *devnull;
+
+/* Return a VM with the standard words and tuslrc.ts loaded, and
+   output going nowhere. */
+static ts_VM *
+make_vm (void)
+{
+  ts_VM *vm = ts_vm_make ();
+  if (NULL == vm)
+    ts_die ("Out of memory");
+  ts_set_output_file_stream (vm, devnull, NULL);
+  ts_install_standard_words (vm);
+  ts_install_unsafe_words (vm);
+  ts_install_array_words (vm);
+  ts_load (vm, "tuslrc.ts");
+  return vm;
+}
+
+/* A benchmark: setup is TUSL code to load once, run is TUSL code to
+   time, doing ops operations of the kind being measured.  (For
+   locals, an op is one binding of a frame plus its uses.) */
+typedef struct Bench {
+  const char *name;
+  const char *setup;
+  const char *run;
+  double ops;
+} Bench;
+
+static const Bench scripted[] = {
+  { "primitives",
+    ":b-prims {n} n (when) 1 2 + 3 * 4 - 5 and drop n 1- b-prims ;",
+    "100000 b-prims", 100000 * 10 },
+  { "colon-calls",
+    ":noop ; :b-calls {n} n (when) noop noop noop noop n 1- b-calls ;",
+    "100000 b-calls", 100000 * 4 },
+  { "locals",
+    ":b-locals {n} n (when) n n n {a b c} a b + c + drop a 1- b-locals ;",
+    "100000 b-locals", 100000 },
+  { "execute",
+    ":nop ; :b-exec {n} n (when) 'nop execute 'nop execute n 1- b-exec ;",
+    "100000 b-exec", 100000 * 2 },
+  { "catch-throw",
+    ":thrower \"x\" throw ; :b-catch {n} n (when) 'thrower catch drop"
+    " n 1- b-catch ;",
+    "20000 b-catch", 20000 },
+  { "output",
+    ":b-out {n} n (when) $x emit n 1- b-out ;",
+    "100000 b-out", 100000 },
+  { "array-sum/element",
+    ":arr (here constant 4096 cells allot)",
+    "arr 4096 array-sum drop", 4096 },
+  { "eg/fib",
+    "\"eg/fib.ts\" load",
+    "20 fib drop", 1 },
+  { "eg/babble",
+    "\"eg/babble.ts\" load",
+    "paper", 1 },
+};
+
+/* Per-benchmark timings */
+typedef struct Result {
+  char name[64];
+  double mean, stddev, best;    /* ns per op */
+  int reps;
+} Result;
+
+static void
+summarize (Result *r, const char *name, const double *ns, int reps)
+{
+  double sum = 0, sq = 0;
+  int i;
+  strncpy (r->name, name, sizeof r->name - 1);
+  r->name[sizeof r->name - 1] = '\0';
+  r->best = ns[0];
+  for (i = 0; i < reps; ++i)
+    {
+      sum += ns[i];
+      if (ns[i] < r->best)
+        r->best = ns[i];
+    }
+  r->mean = sum / reps;
+  for (i = 0; i < reps; ++i)
+    sq += (ns[i] - r->mean) * (ns[i] - r->mean);
+  r->stddev = 1 < reps ? sqrt (sq / (reps - 1)) : 0;
+  r->reps = reps;
+}
+
+enum { max_reps = 100, max_results = 64 };
+
+static Result results[max_results];
+static int nresults = 0;
+
+static void
+run_scripted (const Bench *b, int reps)
+{
+  double ns[max_reps];
+  ts_VM *vm = make_vm ();
+  int i;
+  ts_load_string (vm, b->setup);
+  ts_load_string (vm, b->run);  /* warm up */
+  for (i = 0; i < reps; ++i)
+    {
+      double start = now ();
+      ts_load_string (vm, b->run);
+      ns[i] = (now () - start) * 1e9 / b->ops;
+    }
+  ts_vm_unmake (vm);
+  summarize (&results[nresults++], b->name, ns, reps);
+}
+
+/* Time looking up the first word defined, with `extra' more words
+   defined after it to search past. */
+static void
+run_lookup (int extra, int reps)
+{
+  enum { lookups = 20000 };
+  double ns[max_reps];
+  char name[64];
+  ts_VM *vm = make_vm ();
+  int i, j;
+  for (i = 0; i < extra; ++i)
+    {
+      char def[64];
+      snprintf (def, sizeof def, ":filler-%d ;", i);
+      ts_load_string (vm, def);
+    }
+  for (i = 0; i < reps; ++i)
+    {
+      double start = now ();
+      for (j = 0; j < lookups; ++j)
+        if (ts_not_found == ts_lookup (vm, "+"))
+          ts_die ("lookup failed");
+      ns[i] = (now () - start) * 1e9 / lookups;
+    }
+  ts_vm_unmake (vm);
+  snprintf (name, sizeof name, "lookup/%d-words", extra);
+  summarize (&results[nresults++], name, ns, reps);
+}
+
+/* Time calling a small colon definition from C with ts_call(). */
+static void
+run_host_call (int reps)
+{
+  enum { calls = 100000 };
+  double ns[max_reps];
+  ts_VM *vm = make_vm ();
+  tsint args[2] = { 3, 4 }, result;
+  int handle, i, j;
+  ts_load_string (vm, ":hook {a b} a b * ;");
+  handle = ts_word_handle (vm, "hook");
+  for (i = 0; i < reps; ++i)
+    {
+      double start = now ();
+      for (j = 0; j < calls; ++j)
+        if (NULL != ts_call (vm, handle, args, 2, &result, 1))
+          ts_die ("ts_call failed");
+      ns[i] = (now () - start) * 1e9 / calls;
+    }
+  ts_vm_unmake (vm);
+  summarize (&results[nresults++], "host-call", ns, reps);
+}
+
+/* Time loading tuslrc.ts, rolled back with a marker between runs.
+   One op is one byte of source. */
+static void
+run_load (int reps)
+{
+  double ns[max_reps];
+  ts_VM *vm = make_vm ();
+  ts_Marker marker;
+  long bytes;
+  int i;
+  FILE *fp = fopen ("tuslrc.ts", "r");
+  if (NULL == fp)
+    ts_die ("Can't open tuslrc.ts");
+  fseek (fp, 0, SEEK_END);
+  bytes = ftell (fp);
+  fclose (fp);
+
+  ts_mark (vm, &marker);
+  for (i = 0; i < reps; ++i)
+    {
+      double start = now ();
+      ts_load (vm, "tuslrc.ts");
+      ns[i] = (now () - start) * 1e9 / bytes;
+      ts_forget (vm, &marker);
+    }
+  ts_vm_unmake (vm);
+  summarize (&results[nresults++], "load/byte", ns, reps);
+}
+
+static void
+save_results (const char *filename)
+{
+  FILE *fp = fopen (filename, "w");
+  int i;
+  if (NULL == fp)
+    ts_die ("Can't write results file");
+  fprintf (fp, "# name\tmean_ns\tstddev_ns\tbest_ns\treps\n");
+  for (i = 0; i < nresults; ++i)
+    fprintf (fp, "%s\t%.3f\t%.3f\t%.3f\t%d\n", results[i].name,
+             results[i].mean, results[i].stddev, results[i].best,
+             results[i].reps);
+  fclose (fp);
+}
+
+/* Compare against a saved baseline, returning the number of
+   benchmarks that got slower by more than threshold percent.  We
+   compare best times, which are less noisy than the means. */
+static int
+compare (const char *filename, double threshold)
+{
+  FILE *fp = fopen (filename, "r");
+  char line[256];
+  int regressions = 0;
+  if (NULL == fp)
+    ts_die ("Can't read baseline file");
+  printf ("\n%-24s %12s %12s %8s\n", "vs. baseline", "then best", "now best",
+          "change");
+  while (NULL != fgets (line, sizeof line, fp))
+    {
+      char name[64];
+      double mean, stddev, best;
+      int i;
+      if ('#' == line[0]
+          || 4 != sscanf (line, "%63s %lf %lf %lf", name, &mean, &stddev, &best))
+        continue;
+      for (i = 0; i < nresults; ++i)
+        if (0 == strcmp (name, results[i].name))
+          {
+            double change = 100 * (results[i].best - best) / best;
+            int worse = threshold < change;
+            printf ("%-24s %12.3f %12.3f %+7.1f%%%s\n", name, best,
+                    results[i].best, change, worse ? "  REGRESSED" : "");
+            regressions += worse;
+          }
+    }
+  fclose (fp);
+  return regressions;
+}
+
+static int
+wanted (const char *name, const char *filter)
+{
+  return NULL == filter || NULL != strstr (name, filter);
+}
+
+int
+main (int argc, char **argv)
+{
+  int reps = 5, i;
+  double threshold = 10;
+  const char *out = NULL, *baseline = NULL, *filter = NULL;
+  static const int lookup_sizes[] = { 0, 250, 1000 };
+
+  for (i = 1; i < argc; ++i)
+    if (0 == strcmp (argv[i], "-r") && i + 1 < argc)
+      reps = atoi (argv[++i]);
+    else if (0 == strcmp (argv[i], "-o") && i + 1 < argc)
+      out = argv[++i];
+    else if (0 == strcmp (argv[i], "-b") && i + 1 < argc)
+      baseline = argv[++i];
+    else if (0 == strcmp (argv[i], "-t") && i + 1 < argc)
+      threshold = atof (argv[++i]);
+    else
+      filter = argv[i];
+  if (reps < 1 || max_reps < reps)
+    ts_die ("Bad repetition count");
+
+  devnull = fopen ("/dev/null", "w");
+  if (NULL == devnull)
+    ts_die ("Can't open /dev/null");
+
+  for (i = 0; i < (int) (sizeof scripted / sizeof scripted[0]); ++i)
+    if (wanted (scripted[i].name, filter))
+      run_scripted (&scripted[i], reps);
+  for (i = 0; i < (int) (sizeof lookup_sizes / sizeof lookup_sizes[0]); ++i)
+    if (wanted ("lookup/", filter))
+      run_lookup (lookup_sizes[i], reps);
+  if (wanted ("host-call", filter))
+    run_host_call (reps);
+  if (wanted ("load/byte", filter))
+    run_load (reps);
+
+  printf ("%-24s %12s %12s %12s %5s\n", "benchmark", "mean ns/op",
+          "stddev", "best", "reps");
+  for (i = 0; i < nresults; ++i)
+    printf ("%-24s %12.3f %12.3f %12.3f %5d\n", results[i].name,
+            results[i].mean, results[i].stddev, results[i].best,
+            results[i].reps);
+
+  if (NULL != out)
+    save_results (out);
+  if (NULL != baseline && 0 < compare (baseline, threshold))
+    return 1;
+  return 0;
+}
@@ -0,0 +1,58 @@
+/* Scaling benchmark for worker pools: run a fixed batch of fib jobs
+   on 1, 2, ... N threads and report the speedup over one thread.
+   Usage: bench/pool [max-threads [jobs]] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tusl.h"
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+int
+main (int argc, char **argv)
+{
+  int max_threads = 1 < argc ? atoi (argv[1]) : sysconf (_SC_NPROCESSORS_ONLN);
+  int njobs = 2 < argc ? atoi (argv[2]) : 64;
+  double base = 0;
+  int n;
+  ts_VM *vm = ts_vm_make ();
+  if (NULL == vm)
+    ts_die ("Out of memory");
+  ts_set_output_file_stream (vm, stdout, NULL);
+  ts_install_standard_words (vm);
+  ts_load (vm, "tuslrc.ts");
+  ts_load_string (vm, ":fib {n} n 2 < (if) 1 ; (then) n 1- fib  n 2- fib + ;"
+                      ":job {n} 20 fib drop ;");
+
+  printf ("threads\tjobs\tseconds\tspeedup\n");
+  for (n = 1; n <= max_threads; ++n)
+    {
+      ts_Pool *pool = ts_pool_make (vm, n);
+      double start, elapsed;
+      int i;
+      if (NULL == pool)
+        ts_die ("Couldn't make pool");
+      start = now ();
+      for (i = 0; i < njobs; ++i)
+        ts_pool_submit (pool, ts_lookup (vm, "job"), i);
+      if (0 != ts_pool_wait (pool))
+        ts_die ("A job failed");
+      elapsed = now () - start;
+      if (1 == n)
+        base = elapsed;
+      printf ("%d\t%d\t%.4f\t%.2f\n", n, njobs, elapsed, base / elapsed);
+      ts_pool_unmake (pool);
+    }
+
+  ts_vm_unmake (vm);
+  return 0;
+}
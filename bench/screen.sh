@@ -0,0 +1,68 @@
+#!/bin/sh
+# Count the bytes and frames runansi sends to the terminal for a fixed
+# run of keys through each of the screen demos, as a measure of
+# redisplay cost over a slow link.  Run from the top directory:
+#   bench/screen.sh [path-to-runansi]
+
+runansi=${1:-./runansi}
+out=${TMPDIR:-/tmp}/screen-bench.$$
+trap 'rm -f "$out"' EXIT
+
+up=$(printf '\033[A') down=$(printf '\033[B')
+right=$(printf '\033[C') left=$(printf '\033[D')
+
+# Typing, cursor motion, line edits and page flips, then C-q to quit
+ed_keys() {
+    i=0
+    while [ $i -lt 20 ]; do
+        printf 'The quick brown fox jumps over the lazy dog.\r'
+        i=$((i + 1))
+    done
+    printf '%s%s%s%s' "$up" "$up" "$left" "$left"
+    printf 'xyz\177\177\001\013\005\024\026\026%s\021' "$down"
+}
+
+# Pushing boxes around and undoing some of it, then q to quit
+sokoban_keys() {
+    i=0
+    while [ $i -lt 10 ]; do
+        printf '%s%s%s%s%s%s' "$left" "$left" "$up" "$right" "$down" "$down"
+        printf 'uu'
+        i=$((i + 1))
+    done
+    printf 'q'
+}
+
+# The same keys, but in bursts with pauses between, like auto-repeat:
+# input goes idle after each burst, so a paced run can catch up then.
+# Where the frame boundaries fall depends on timing, so paced figures
+# vary from run to run; compare them over several runs.
+sokoban_bursts() {
+    i=0
+    while [ $i -lt 10 ]; do
+        printf '%s%s%s%s%s%s' "$left" "$left" "$up" "$right" "$down" "$down"
+        printf 'uu'
+        sleep 0.2
+        i=$((i + 1))
+    done
+    printf 'q'
+}
+
+# A frame that changed anything starts by hiding the cursor.
+measure() {
+    name=$1 keys=$2
+    shift 2
+    nkeys=$($keys | wc -c)
+    $keys | "$runansi" "$@" >"$out" || exit 1
+    bytes=$(wc -c <"$out")
+    frames=$(grep -ao "$(printf '\033')\[?25l" "$out" | wc -l)
+    printf '%-20s %5d key bytes %8d output bytes %6d per key byte %5d frames\n' \
+        "$name" $nkeys $bytes $((bytes / nkeys)) $frames
+}
+
+measure ed.ts ed_keys '"eg-curst/ed.ts" load' '"README" edit'
+measure sokoban.ts sokoban_keys '"eg-curst/sokoban.ts" load' '(play)'
+measure 'sokoban.ts, bursts' sokoban_bursts \
+    '"eg-curst/sokoban.ts" load' '(play)'
+measure 'sokoban.ts, paced' sokoban_bursts \
+    '"eg-curst/sokoban.ts" load' '(50 screen-frame-ms play)'
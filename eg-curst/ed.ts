@@ -152,14 +152,27 @@
 \ M-< M-> M-c M-d M-l M-t M-u M-w M-z 
 \ M-left M-right M-up M-down M-a M-e 
 
-:blast-line {i}       0  i  i width * buffer +  width  screen-blast ;
-:blast-page     height 'blast-line for 
-                0 height messages width screen-blast ;
-
+\ The page goes to the screen in one screen-blast-batch, a record of
+\ x, y, address and length for each line and one for the messages.
+:blasts         (here constant  height 1+ 4 * cells allot)
+:blast! {x y a u r}   x r !  y r cell+ !  a r 2 cells + !  u r 3 cells + ! ;
+:blast-line {i}       0  i  i width * buffer +  width  blasts i 4 * cells +  blast! ;
+:blast-page     height 'blast-line for
+                0 height messages width  blasts height 4 * cells +  blast!
+                blasts height 1+ screen-blast-batch ;
+
+:keys           (here constant  64 cells allot)
+
+\ React to the n keys at a, stopping at C-q; say whether we did.
+:reacting {a n} n 0= (if)  false ;  (then)
+                a @ $Q ctrl = (if)  true ;  (then)
+                a @ react
+\                a @ .notify
+                a cell+  n 1-  reacting ;
+
+\ Redisplay once per batch of keys, not once per key.
 :editing        blast-page  coords screen-refresh
-                get-key {key}  key $Q ctrl = (unless)
-                  key react
-\                  key .notify
+                keys 64 get-keys {n}  keys n reacting (unless)
                   editing ;
 
 :?complain {plaint}
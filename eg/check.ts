@@ -0,0 +1,339 @@
+\ Smoke tests run by `make check', for either cell size.
+\ An uncaught error exits with a nonzero status.
+
+:expect {got want name}  got want = (unless)  name error ;
+
+(2 3 + 5 "arithmetic" expect)
+(-7 2 / -3 "division" expect)
+(-1 1 u< 0 "unsigned compare" expect)
+(-2147483648 0< true "literal range" expect)
+(1 cells 4 <  false "cell size" expect)
+
+\ Arithmetic wraps at the cell width, whichever it is.
+:max-cell  -1 1 u>> ;
+(max-cell 1+  max-cell negate 1-  "cells wrap" expect)
+:sign-bit  1  1 cells 8 * 1-  << ;
+(sign-bit 0< true "top bit is the sign" expect)
+:check-cell32  1 cells 4 = (when)
+  2147483647 1+ -2147483648 "32-bit overflow" expect
+  65536 65536 *  0 "32-bit product" expect
+  16777217 i>f f>i  16777216 "single-precision float" expect ;
+:check-cell64  1 cells 8 = (when)
+  2147483647 1+ 2147483648 "64-bit sum" expect
+  65536 65536 *  4294967296 "64-bit product" expect
+  16777217 i>f f>i  16777217 "double-precision float" expect ;
+(check-cell32  check-cell64)
+
+(3 i>f 4 i>f f* f>i  12 "float multiply" expect)
+(2 i>f fsqrt dup f* fround f>i  2 "fsqrt" expect)
+
+:fib {n}  n 2 < (if) 1 ; (then)  n 1- fib  n 2- fib + ;
+(20 fib 10946 "fib" expect)
+
+:numbers (here constant  5 , 3 , 9 , -1 , )
+(numbers 4 array-sum 16 "array-sum" expect)
+(numbers 4 sort-cells)
+(numbers @ -1 "sort-cells" expect)
+(numbers 3 cells + @ 9 "sort-cells" expect)
+
+\ An inconsistent comparison gives some order, but mustn't crash.
+:many (here constant  100 cells allot)
+:fill-many {i}  i 1+  many i cells +  ! ;
+:yes {x y}  true ;
+(100 'fill-many for)
+(many 100 'yes sort-cells-by)
+(many 100 array-sum 5050 "sort-cells-by, inconsistent" expect)
+(many 100 50 'yes nth-element-by)
+(many 100 array-sum 5050 "nth-element-by, inconsistent" expect)
+
+\ Each array word agrees with a plain loop, for lengths on either side
+\ of the vector widths, and for length 0.
+:xs (here constant  100 cells allot)
+:ys (here constant  100 cells allot)
+:zs (here constant  100 cells allot)
+:ws (here constant  100 cells allot)
+:at {a i}  a i cells + ;
+:fill-xs {i}  i 37 * 101 mod 50 -  xs i at ! ;
+:fill-ys {i}  i 11 * 23 mod 11 -  ys i at ! ;
+(100 'fill-xs for  100 'fill-ys for)
+:fold {a n z w}  n 0= (if) z ; (then)
+  a n 1- z w fold  a n 1- at @  w execute ;
+:dot-loop {a b n}  n 0= (if) 0 ; (then)
+  a b n 1- dot-loop  a n 1- at @  b n 1- at @ * + ;
+:count-loop {a n x}  n 0= (if) 0 ; (then)
+  a n 1- x count-loop  a n 1- at @ x < (if) 1+ (then) ;
+:same-cells? {a b n}  n 0= (if) true ; (then)
+  a n 1- at @  b n 1- at @ = (if) a b n 1- same-cells? ; (then) false ;
+:copy {a b n}  n 0= (if) ; (then)  a n 1- at @  b n 1- at !  a b n 1- copy ;
+:add-at {i}  xs i at @  ys i at @ +  ws i at ! ;
+:mul-at {i}  xs i at @  ys i at @ *  ws i at ! ;
+:axpy-at {i}  ys i at @  3 xs i at @ * +  ws i at ! ;
+:prefix-at {i}  xs i 1+ 0 '+ fold  ws i at ! ;
+:check-ints {n}
+  xs n array-sum  xs n 0 '+ fold  "array-sum" expect
+  xs ys n array-dot  xs ys n dot-loop  "array-dot" expect
+  xs n 7 array-count<  xs n 7 count-loop  "array-count<" expect
+  xs ys zs n array-add  n 'add-at for
+  zs ws n same-cells? true "array-add" expect
+  xs ys zs n array-mul  n 'mul-at for
+  zs ws n same-cells? true "array-mul" expect
+  ys zs n copy  3 xs zs n array-axpy  n 'axpy-at for
+  zs ws n same-cells? true "array-axpy" expect
+  xs zs n copy  zs n array-prefix-sum  n 'prefix-at for
+  zs ws n same-cells? true "array-prefix-sum" expect
+  n 0= (if) ; (then)
+  xs n array-min  xs n xs @ 'min fold  "array-min" expect
+  xs n array-max  xs n xs @ 'max fold  "array-max" expect ;
+
+\ The same for floats, all whole numbers so that any order of
+\ summing gives the same result.
+:fxs (here constant  100 cells allot)
+:fys (here constant  100 cells allot)
+:to-float {a b i}  a i at @ i>f  b i at ! ;
+:fill-fxs {i}  xs fxs i to-float ;
+:fill-fys {i}  ys fys i to-float ;
+(100 'fill-fxs for  100 'fill-fys for)
+:fexpect {got want name}  got want f= true name expect ;
+:fdot-loop {a b n}  n 0= (if) 0 i>f ; (then)
+  a b n 1- fdot-loop  a n 1- at @  b n 1- at @ f* f+ ;
+:fcount-loop {a n x}  n 0= (if) 0 ; (then)
+  a n 1- x fcount-loop  a n 1- at @ x f< (if) 1+ (then) ;
+:same-floats? {a b n}  n 0= (if) true ; (then)
+  a n 1- at @  b n 1- at @ f= (if) a b n 1- same-floats? ; (then) false ;
+:fadd-at {i}  fxs i at @  fys i at @ f+  ws i at ! ;
+:fmul-at {i}  fxs i at @  fys i at @ f*  ws i at ! ;
+:faxpy-at {i}  fys i at @  3 i>f fxs i at @ f* f+  ws i at ! ;
+:fprefix-at {i}  fxs i 1+ 0 i>f 'f+ fold  ws i at ! ;
+:check-floats {n}
+  fxs n farray-sum  fxs n 0 i>f 'f+ fold  "farray-sum" fexpect
+  fxs fys n farray-dot  fxs fys n fdot-loop  "farray-dot" fexpect
+  fxs n 7 i>f farray-count<  fxs n 7 i>f fcount-loop  "farray-count<" expect
+  fxs fys zs n farray-add  n 'fadd-at for
+  zs ws n same-floats? true "farray-add" expect
+  fxs fys zs n farray-mul  n 'fmul-at for
+  zs ws n same-floats? true "farray-mul" expect
+  fys zs n copy  3 i>f fxs zs n farray-axpy  n 'faxpy-at for
+  zs ws n same-floats? true "farray-axpy" expect
+  fxs zs n copy  zs n farray-prefix-sum  n 'fprefix-at for
+  zs ws n same-floats? true "farray-prefix-sum" expect
+  n 0= (if) ; (then)
+  fxs n farray-min  fxs n fxs @ 'fmin fold  "farray-min" fexpect
+  fxs n farray-max  fxs n fxs @ 'fmax fold  "farray-max" fexpect ;
+
+:lengths (here constant  0 , 1 , 3 , 4 , 5 , 7 , 8 , 9 , 15 , 16 , 17 ,
+                         31 , 33 , 100 ,)
+:check-length {i}  lengths i at @ check-ints  lengths i at @ check-floats ;
+(14 'check-length for)
+:min-of-none  xs 0 array-min ;
+:fmax-of-none  fxs 0 farray-max ;
+('min-of-none catch 0= false "array-min of nothing" expect)
+('fmax-of-none catch 0= false "farray-max of nothing" expect)
+
+\ Sorting and searching on duplicates, sorted and reversed input.
+:in-order? {a n w}  n 2 < (if) true ; (then)
+  a n 2- at @  a n 1- at @  w execute (if) a n 1- w in-order? ; (then) false ;
+:u<= {m n}  n m u< 0= ;
+:fill-dups {i}  i 7 mod 3 -  xs i at ! ;
+:fill-up {i}  i  xs i at ! ;
+:fill-down {i}  100 i -  xs i at ! ;
+:check-sorts {w}
+  100 w for  xs 100 array-sum  xs 100 sort-cells
+  xs 100 '<= in-order? true "sort-cells order" expect
+  xs 100 array-sum "sort-cells keeps the elements" expect
+  100 w for  xs zs 100 copy  zs 100 sort-cells
+  xs 100 37 nth-element  xs 37 at @  zs 37 at @  "nth-element" expect
+  xs 37 xs 37 at @ 1+ array-count<  37 "nth-element before" expect
+  xs 38 at 62 xs 37 at @ array-count<  0 "nth-element after" expect ;
+('fill-dups check-sorts  'fill-up check-sorts  'fill-down check-sorts)
+
+\ usort-cells puts negative numbers last; fsort sorts floats.
+(100 'fill-dups for  xs 100 usort-cells)
+(xs 100 'u<= in-order? true "usort-cells order" expect)
+(xs @ 0< false "usort-cells, first" expect)
+(xs 99 at @ 0< true "usort-cells, last" expect)
+:fill-fdups {i}  i 7 mod 3 -  i>f  -2 i>f f/  fxs i at ! ;
+(100 'fill-fdups for  fxs 100 farray-sum  fxs 100 fsort)
+(fxs 100 'f<= in-order? true "fsort order" expect)
+(fxs 100 farray-sum f= true "fsort keeps the elements" expect)
+(fxs @  3 i>f -2 i>f f/  f= true "fsort, first" expect)
+
+\ bsearch-cells finds where a key goes, present or not.
+:fill-evens {i}  i 2 *  xs i at ! ;
+(100 'fill-evens for)
+:bsearch-expect {x i flag}  xs 100 x bsearch-cells
+  flag "bsearch-cells flag" expect  i "bsearch-cells index" expect ;
+(50 25 true bsearch-expect  51 26 false bsearch-expect)
+(-5 0 false bsearch-expect  999 100 false bsearch-expect)
+(xs 0 7 bsearch-cells  false "bsearch-cells empty" expect
+                       0 "bsearch-cells in nothing" expect)
+(100 'fill-dups for  xs 100 sort-cells)
+(xs 100 0 bsearch-cells  true "bsearch-cells dup found" expect
+ xs 100 0 array-count<  "bsearch-cells finds the first dup" expect)
+:later {x y}  y x < ;
+(100 'fill-evens for  xs 100 'later sort-cells-by)
+(xs 100 150 'later bsearch-cells-by  true "bsearch-cells-by found" expect
+ 24 "bsearch-cells-by" expect)
+(xs 100 51 'later bsearch-cells-by  false "bsearch-cells-by missing" expect
+ 74 "bsearch-cells-by gap" expect)
+
+:table (8 hash-table constant)
+(100 7 table hash-put  200 -7 table hash-put)
+(7 table hash-get  true "hash-get" expect  100 "hash-get" expect)
+(table hash-count 2 "hash-count" expect)
+
+\ Deleting any key from a crowded table shifts the rest of its run
+\ back without losing anything.
+:dtable (here constant 0 ,)
+:hits (here constant 0 ,)
+:put-key {i}  i 100 *  i  dtable @ hash-put ;
+:fill-6  8 hash-table dtable !  1 7 'put-key for-range ;
+:count-hit {i}  i dtable @ hash-get  swap i 100 * =  and
+               (if) 1 hits +! (then) ;
+:check-delete {k}
+  fill-6  k dtable @ hash-delete true "hash-delete finds it" expect
+  0 hits !  1 7 'count-hit for-range  hits @ 5 "hash-delete survivors" expect
+  k dtable @ hash-get swap drop false "hash-delete removes it" expect
+  dtable @ hash-count 5 "hash-count after delete" expect
+  k dtable @ hash-delete false "hash-delete again" expect ;
+(1 7 'check-delete for-range)
+
+\ Growing from 8 slots keeps every entry.
+(8 hash-table dtable !  1 61 'put-key for-range)
+(dtable @ cell+ @ 64 < false "hash table grows" expect)
+(dtable @ hash-count 60 "hash-count after growing" expect)
+(0 hits !  1 61 'count-hit for-range)
+(hits @ 60 "entries survive growing" expect)
+
+\ hash-each visits every entry once.
+:visits (here constant  61 cells allot)
+:clear-visit {i}  0  visits i cells +  ! ;
+:visit {key value}  value key 100 * = (if) 1  visits key cells +  +! (then) ;
+:once? {i}  visits i cells + @ 1 = (if) 1 hits +! (then) ;
+(0 61 'clear-visit for-range  'visit dtable @ hash-each)
+(0 hits !  0 61 'once? for-range)
+(hits @ 60 "hash-each visits each once" expect)
+
+\ String keys match by contents.
+:apple-1  "apple" ;
+:apple-2  "apple" ;
+:stable (4 string-hash-table constant)
+(apple-1 apple-2 = false "two copies of a string" expect)
+(42 apple-1 stable hash-put  7 "pear" stable hash-put)
+(apple-2 stable hash-get  true "string key lookup" expect
+                          42 "string key" expect)
+("plum" stable hash-get  swap drop false "missing string key" expect)
+(apple-2 stable hash-delete  true "string key delete" expect)
+(apple-1 stable hash-get  swap drop false "string key deleted" expect)
+(apple-1 string-hash  apple-2 string-hash = true "string-hash" expect)
+(apple-1 string-hash  "pear" string-hash = false "string-hash differs" expect)
+
+\ A clobbered header gets an error, not a crash.
+:broken (8 hash-table constant)
+:probe-broken  1 broken hash-get drop drop ;
+(0 broken cell+ !  'probe-broken catch 0= false "bad hash capacity" expect)
+(6 broken cell+ !  'probe-broken catch 0= false "odd hash capacity" expect)
+
+(100 allocate 200 resize  dup 0< false "resize" expect  free)
+
+\ Freeing what isn't an allocated block is an error, even with a
+\ header forged to look like one.
+:block (here constant 0 ,)
+:info (here constant 0 ,)
+:free-block  block @ free ;
+(100 allocate block !  block @ cell- @ info !  free-block)
+('free-block catch 0= false "double free" expect)
+(info @  block @ cell- !  'free-block catch 0= false "forged free" expect)
+(numbers cell+ block !  'free-block catch 0= false "foreign free" expect)
+
+\ A marker takes back the words, data and heap defined after it.
+:mark-here (here constant 0 ,)
+:mark-where (here constant 0 ,)
+:rollback (marker)
+(here mark-here !  where mark-where !)
+:temp 42 ;
+(100 allot  3000 allocate free)
+("temp" find swap drop true "word before rollback" expect)
+(rollback)
+(here mark-here @ "marker restores here" expect)
+(where mark-where @ "marker restores where" expect)
+("temp" find swap drop false "marker forgets words" expect)
+(3000 allocate  mark-here @ cell+  "marker drops heap blocks" expect)
+(rollback  "rollback" find swap drop true "marker survives itself" expect)
+
+\ par-for keeps each index's own bytes and nothing else.
+:squares (here constant  1000 cells allot)
+:stray (here constant 0 ,)
+:square {i}  i i *  squares i cells +  !  1 stray ! ;
+:zero-square {i}  0  squares i cells +  ! ;
+(0 stray !  squares 1 cells 1000 'square par-for)
+(squares 1000 array-sum 332833500 "par-for" expect)
+(stray @ 0 "par-for discards stray writes" expect)
+(1000 'zero-square for  squares 1 cells 1000 'square par-for-static)
+(squares 1000 array-sum 332833500 "par-for-static" expect)
+:failing-square {i}  i 500 = (if) "square trouble" error (then) ;
+:fail-squares  squares 1 cells 1000 'failing-square par-for ;
+('fail-squares catch 0= false "par-for error" expect)
+
+\ A par-for worker's clone mustn't switch its original's tasks.
+:idle  ;
+:spawner {i}  'idle spawn drop ;
+:spawn-in-workers  0 0 4 'spawner par-for ;
+('spawn-in-workers catch 0= false "par-for refuses spawn" expect)
+:flag (here constant  0 ,)
+:raise-flag  42 flag ! ;
+('raise-flag spawn resume  flag @ 42 "spawn after par-for" expect)
+
+\ A finished task gets reused rather than piling up.
+:bump  1 flag +! ;
+:spawn-bump {i}  'bump spawn resume ;
+\ Tasks take turns at each yield.
+:log (here constant 0 ,)
+:note {d}  log @ 10 *  d +  log ! ;
+:odds  1 note yield  3 note yield  5 note ;
+:evens  2 note yield  4 note ;
+:task (here constant 0 ,)
+(0 log !  'odds spawn task !  task @ resume  log @ 1 "resume" expect)
+(task @ task-done? false "task-done? while suspended" expect)
+('evens spawn resume  task @ resume  log @ 123 "yield" expect)
+(task @ resume  log @ 1235 "last resume" expect)
+(task @ task-done? true "task-done? when done" expect)
+:resume-task  task @ resume ;
+('resume-task catch 0= false "resume of a done task" expect)
+:failing  "task trouble" error ;
+('failing spawn task !  'resume-task catch 0= false "task error" expect)
+
+\ run-tasks keeps going round till every task is done.
+:counter (here constant 0 ,)
+:count-3  1 counter +! yield  1 counter +! yield  1 counter +! ;
+(0 counter !  'count-3 spawn drop  'count-3 spawn drop  run-tasks)
+(counter @ 6 "run-tasks" expect)
+
+(0 flag !  1000 'spawn-bump for  flag @ 1000 "tasks run" expect)
+('bump spawn dup resume  'bump spawn = true "finished task reused" expect)
+
+\ Literals either side of the short-literal range in compact code.
+:lit-16s  32767 32768 -32768 -32769 ;
+(lit-16s  -32769 "literal -32769" expect  -32768 "literal -32768" expect
+          32768 "literal 32768" expect  32767 "literal 32767" expect)
+:lit-big  65535 65536 2147483647 ;
+(lit-big  2147483647 "literal 2^31-1" expect
+          65536 "literal 65536" expect  65535 "literal 65535" expect)
+
+\ All six locals, and a tail call deep enough to overflow without reuse.
+:six-locals {a b c d e f}  a b - c * d + e f * - ;
+(1 2 3 4 5 6 six-locals  -29 "six locals" expect)
+:countdown {n}  42  n 0= (unless) drop  n 1- countdown ;
+(100000 countdown  42 "deep tail call" expect)
+
+\ A defining word whose ;will code follows a long forward branch.
+:pairs          given  ;will {u a}  u cells a + @ ;
+:squares (pairs  0 ,  1 ,  4 ,  9 ,)
+(3 squares  9 "given/;will" expect)
+:far-branch {n}
+  0  n (if) drop 1 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+
+         1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+
+         1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ 1+ (then) ;
+(0 far-branch  0 "branch not taken" expect)
+(1 far-branch  61 "branch taken" expect)
+
+("ok" type cr)
@@ -0,0 +1,904 @@
+/* Checks of the C interface, run by `make check' from the top
+   directory under each build variant, alongside eg/check.ts.  Exits
+   with a complaint at the first thing that's wrong. */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tusl.h"
+
+static void
+expect (int ok, const char *what)
+{
+  if (!ok)
+    {
+      fprintf (stderr, "checkapi: %s\n", what);
+      exit (1);
+    }
+}
+
+/* Return a new VM with the standard words and tuslrc.ts loaded. */
+static ts_VM *
+make_vm (void)
+{
+  ts_VM *vm = ts_vm_make ();
+  expect (NULL != vm, "ts_vm_make");
+  ts_set_output_file_stream (vm, stdout, NULL);
+  ts_install_standard_words (vm);
+  ts_load (vm, "tuslrc.ts");
+  return vm;
+}
+
+/* Return the value of running the word named name with no arguments. */
+static tsint
+call_0 (ts_VM *vm, const char *name)
+{
+  tsint result = 0;
+  expect (NULL == ts_call (vm, ts_word_handle (vm, name), NULL, 0,
+                           &result, 1),
+          name);
+  return result;
+}
+
+
+/* Cell size */
+
+/* The library must agree with how this was compiled: with
+   -DTS_CELL32 for libtusl32.a, and without for libtusl.a. */
+static void
+check_cells (void)
+{
+  ts_VM *vm = make_vm ();
+  tsint args[2], result;
+  ts_load_string (vm, ":cell-size  1 cells ;  :add  + ;");
+#ifdef TS_CELL32
+  expect (4 == sizeof (tsint) && 4 == sizeof (tsfloat), "32-bit cells");
+#else
+  expect (8 == sizeof (tsint) && 8 == sizeof (tsfloat), "64-bit cells");
+#endif
+  expect ((tsint) sizeof (tsint) == call_0 (vm, "cell-size"),
+          "the library's cell size");
+  args[0] = (tsint) ((tsuint) -1 >> 1), args[1] = 1;
+  expect (NULL == ts_call (vm, ts_word_handle (vm, "add"), args, 2,
+                           &result, 1)
+          && result == -args[0] - 1,
+          "overflow wraps at the cell width");
+  ts_vm_unmake (vm);
+}
+
+
+/* Branches */
+
+/* A forward branch over far more code than a colon definition
+   usually holds, yet small enough for 64-bit cells to fit in data
+   space: compact code stores the offset relative to the branch in a
+   16-bit unit. */
+static void
+check_branches (void)
+{
+  enum { steps = 4000 };
+  static const char head[] = ":far {n}  0  n (if) drop 0";
+  static const char tail[] = " (then) ;";
+  ts_VM *vm = make_vm ();
+  char *source = malloc (sizeof head + 3 * steps + sizeof tail);
+  char *p = source;
+  tsint arg, result;
+  int i;
+  expect (NULL != source, "malloc");
+  p = stpcpy (p, head);
+  for (i = 0; i < steps; ++i)
+    p = stpcpy (p, " 1+");
+  strcpy (p, tail);
+  ts_load_string (vm, source);
+  free (source);
+  arg = 0;
+  expect (NULL == ts_call (vm, ts_word_handle (vm, "far"), &arg, 1,
+                           &result, 1)
+          && 0 == result,
+          "long branch not taken");
+  arg = 1;
+  expect (NULL == ts_call (vm, ts_word_handle (vm, "far"), &arg, 1,
+                           &result, 1)
+          && steps == result,
+          "long branch taken");
+  ts_vm_unmake (vm);
+}
+
+
+/* Memory use */
+
+static void
+check_stats (void)
+{
+  ts_VM *vm = make_vm ();
+  ts_VM_stats before, after;
+  ts_Marker marker;
+  int i;
+  ts_vm_stats (vm, &before);
+  expect (1 == before.nloads
+          && 0 == strcmp (before.loads[0].filename, "tuslrc.ts")
+          && 1 == before.loads[0].loads
+          && 0 < before.loads[0].words
+          && before.loads[0].code_bytes <= before.code_bytes,
+          "load stats for tuslrc.ts");
+  ts_mark (vm, &marker);
+  ts_load_string (vm, ":five 5 ;  :greeting \"a string\" ;"
+                      "(1 2 3)");
+  ts_vm_stats (vm, &after);
+  expect (before.stack_cells + 3 == after.stack_cells
+          && after.stack_cells <= after.stack_cells_peak,
+          "stack stats");
+  expect (before.words + 2 == after.words
+          && before.code_bytes < after.code_bytes
+          && before.string_bytes < after.string_bytes,
+          "stats count what gets defined");
+  for (i = 0; i < 3; ++i)
+    ts_pop (vm);
+  ts_forget (vm, &marker);
+  ts_vm_stats (vm, &after);
+  expect (before.words == after.words && before.words < after.words_peak
+          && before.code_bytes == after.code_bytes
+          && before.code_bytes < after.code_bytes_peak
+          && before.string_bytes < after.string_bytes_peak,
+          "peaks outlast a forget");
+  ts_vm_unmake (vm);
+}
+
+
+/* String literals typed at the top level go in the scratch pad
+   instead of using up string space. */
+static void
+check_scratch (void)
+{
+  ts_VM *vm = make_vm (), *plain = make_vm ();
+  ts_Marker marker;
+  int there, plain_there, i;
+  ts_install_unsafe_words (vm);
+  ts_mark (vm, &marker);
+  ts_set_scratch_pad (vm, 256);
+  there = vm->there;
+  for (i = 0; i < 100000; ++i)
+    ts_load_string (vm, "(\"hello\" \"world\" drop drop)");
+  expect (there == vm->there, "scratch strings get reclaimed");
+
+  ts_load_string (vm, "(\"kept\")");
+  ts_load_string (vm, "(\"other\" drop)");
+  expect (0 == strcmp (ts_data_byte (vm, ts_pop (vm)), "kept"),
+          "a scratch string left on the stack survives");
+
+  /* Only the filename goes in the pad; what the file defines stays. */
+  plain_there = plain->there;
+  ts_load (plain, "tuslrc.ts");
+  ts_load_string (vm, "(\"tuslrc.ts\" load)");
+  expect (there - vm->there == plain_there - plain->there,
+          "a load command's filename gets reclaimed");
+  ts_load_string (vm, "(\"0123456789abcdef\" drop)");
+  expect (' ' == call_0 (vm, "bl"),
+          "words loaded by a command outlive its scratch strings");
+
+  ts_forget (vm, &marker);
+  expect (0 == vm->scratch_size, "forgetting the scratch pad");
+  ts_vm_unmake (plain);
+  ts_vm_unmake (vm);
+}
+
+/* Identical compiled string literals share one copy when interned,
+   but never with a scratch string. */
+static void
+check_interning (void)
+{
+  ts_VM *vm = make_vm ();
+  ts_set_scratch_pad (vm, 256);
+  vm->intern_strings = 1;
+  ts_load_string (vm, ":a \"same\" ;  :b \"same\" ;  :c \"other\" ;");
+  expect (call_0 (vm, "a") == call_0 (vm, "b"), "interned duplicates");
+  expect (call_0 (vm, "a") != call_0 (vm, "c"), "interned distinct strings");
+  ts_load_string (vm, "(\"scratch\" drop)  :d \"scratch\" ;");
+  ts_load_string (vm, "(\"clobber\" drop)");
+  expect (0 == strcmp (ts_data_byte (vm, call_0 (vm, "d")), "scratch"),
+          "interning skips the scratch pad");
+  ts_vm_unmake (vm);
+}
+
+
+/* Calls from C */
+
+static void
+check_call (void)
+{
+  ts_VM *vm = make_vm ();
+  ts_VM_stats before, after;
+  tsint args[3] = { 10, 3, 2 }, results[2];
+  int sub3, pair, fail;
+  const char *complaint;
+  ts_load_string (vm, ":sub3 {a b c}  a b - c - ;"
+                      ":pair {a}  a  a 1+ ;"
+                      ":fail {a}  a (if) \"first trouble\" error (then)"
+                      "           \"second trouble\" error ;");
+  sub3 = ts_word_handle (vm, "sub3");
+  pair = ts_word_handle (vm, "pair");
+  fail = ts_word_handle (vm, "fail");
+  expect (ts_not_found == ts_word_handle (vm, "no-such-word"),
+          "ts_word_handle of an undefined word");
+  expect (ts_not_found == ts_word_handle (vm, ";"),
+          "ts_word_handle of a sequential-only word");
+
+  ts_vm_stats (vm, &before);
+  expect (NULL == ts_call (vm, sub3, args, 3, results, 1)
+          && 5 == results[0],
+          "ts_call passes args deepest first");
+  expect (NULL == ts_call (vm, pair, args, 1, results, 2)
+          && 10 == results[0] && 11 == results[1],
+          "ts_call returns results topmost last");
+  complaint = ts_call (vm, fail, args, 1, NULL, 0);
+  expect (NULL != complaint && NULL != strstr (complaint, "first trouble"),
+          "ts_call returns the complaint");
+  expect (NULL != ts_call (vm, sub3, args, 3, results, 2),
+          "ts_call with too few results");
+  ts_vm_stats (vm, &after);
+  expect (before.stack_cells == after.stack_cells,
+          "ts_call leaves the stack as it was");
+
+  {
+    tsint yes = -1, no = 0;
+    ts_Call calls[4];
+    memset (calls, 0, sizeof calls);
+    calls[0].handle = sub3, calls[0].args = args, calls[0].nargs = 3;
+    calls[0].results = results, calls[0].nresults = 1;
+    calls[1].handle = fail, calls[1].args = &yes, calls[1].nargs = 1;
+    calls[2].handle = fail, calls[2].args = &no, calls[2].nargs = 1;
+    calls[3].handle = pair, calls[3].args = args + 2, calls[3].nargs = 1;
+    calls[3].results = results, calls[3].nresults = 2;
+    expect (2 == ts_call_batch (vm, calls, 4), "ts_call_batch failures");
+    expect ('\0' == calls[0].complaint[0] && '\0' == calls[3].complaint[0],
+            "ts_call_batch successes");
+    expect (NULL != strstr (calls[1].complaint, "first trouble")
+            && NULL != strstr (calls[2].complaint, "second trouble"),
+            "ts_call_batch keeps each complaint");
+    expect (2 == results[0] && 3 == results[1],
+            "ts_call_batch keeps going after a failure");
+  }
+  ts_vm_stats (vm, &after);
+  expect (before.stack_cells == after.stack_cells,
+          "ts_call_batch leaves the stack as it was");
+  ts_vm_unmake (vm);
+}
+
+
+/* Foreign functions */
+
+static tsint
+count_char (const char *s, tsint c)
+{
+  tsint n = 0;
+  for (; '\0' != *s; ++s)
+    n += c == *s;
+  return n;
+}
+
+static void
+upcase (char *s)
+{
+  for (; '\0' != *s; ++s)
+    if ('a' <= *s && *s <= 'z')
+      *s -= 'a' - 'A';
+}
+
+static tsint
+sum12 (tsint a, tsint b, tsint c, tsint d, tsint e, tsint f,
+       tsint g, tsint h, tsint i, tsint j, tsint k, tsint l)
+{
+  return a + b + c + d + e + f + g + h + i + j + k + l;
+}
+
+/* Return true iff vm won't install a foreign word of signature. */
+static int
+refuses (ts_VM *vm, const char *signature)
+{
+  ts_TRY (vm, frame)
+    {
+      ts_install_foreign (vm, "bad", (void (*)(void)) abs, signature);
+      ts_POP_TRY (vm, frame);
+      return 0;
+    }
+  ts_EXCEPT (vm, frame)
+    return 1;
+}
+
+/* Each kind of argument and result reaches C as its declared type. */
+static void
+check_foreign (void)
+{
+  ts_VM *vm = make_vm ();
+  tsint args[12], result;
+  tsfloat x;
+  int i;
+#ifdef TS_CELL32
+  ts_install_foreign (vm, "abs", (void (*)(void)) abs, "i:i");
+#else
+  ts_install_foreign (vm, "abs", (void (*)(void)) llabs, "i:i");
+#endif
+  ts_install_foreign (vm, "pow", (void (*)(void)) pow, "dd:d");
+  ts_install_foreign (vm, "count-char", (void (*)(void)) count_char, "pi:i");
+  ts_install_foreign (vm, "upcase", (void (*)(void)) upcase, "p:v");
+  ts_install_foreign (vm, "sum12", (void (*)(void)) sum12, "iiiiiiiiiiii:i");
+  ts_load_string (vm, ":minus-big  -2000000000 abs ;"
+                      ":as  \"banana\" $a count-char ;"
+                      ":word  \"shout\" ;  (word upcase)");
+
+  expect (2000000000 == call_0 (vm, "minus-big"), "foreign i:i");
+  expect (3 == call_0 (vm, "as"), "foreign pi:i");
+  expect (0 == strcmp (ts_data_byte (vm, call_0 (vm, "word")), "SHOUT"),
+          "foreign p:v");
+  x = 2, memcpy (&args[0], &x, sizeof x);
+  x = 10, memcpy (&args[1], &x, sizeof x);
+  expect (NULL == ts_call (vm, ts_word_handle (vm, "pow"), args, 2,
+                           &result, 1),
+          "foreign dd:d");
+  memcpy (&x, &result, sizeof x);
+  expect (1024 == x, "foreign dd:d result");
+  for (i = 0; i < 12; ++i)
+    args[i] = i + 1;
+  expect (NULL == ts_call (vm, ts_word_handle (vm, "sum12"), args, 12,
+                           &result, 1)
+          && 78 == result,
+          "foreign i12:i");
+
+  expect (refuses (vm, "ii") && refuses (vm, "x:i") && refuses (vm, "i:x")
+          && refuses (vm, "i:ii") && refuses (vm, "iiiiiiiiiiiii:i")
+          && refuses (vm, "iipd:v") && refuses (vm, "ip:p"),
+          "unsupported foreign signatures");
+  ts_vm_unmake (vm);
+}
+
+
+/* Cloning */
+
+/* A clone starts with a copy of everything and then goes its own way,
+   outliving its original if need be. */
+static void
+check_clone (void)
+{
+  ts_VM *vm = make_vm (), *clone;
+  ts_VM_stats stats;
+  ts_load_string (vm, ":counter (here constant  5 ,)"
+                      ":count  counter @ ;"
+                      ":bump  1 counter +! ;"
+                      ":deep {n}  n 0= (if) 0 ; (then)  n 1- deep 1+ ;"
+                      "(100 deep drop)");
+  clone = ts_vm_clone (vm);
+  expect (NULL != clone, "ts_vm_clone");
+  ts_vm_stats (vm, &stats);
+  expect (100 <= stats.call_depth_peak, "original's call depth peak");
+  ts_vm_stats (clone, &stats);
+  expect (0 == stats.call_depth && 0 == stats.call_depth_peak,
+          "clone starts with fresh call depth stats");
+  expect (5 == call_0 (clone, "count"), "clone copies data");
+  expect (NULL == ts_call (clone, ts_word_handle (clone, "bump"), NULL, 0,
+                           NULL, 0),
+          "bump");
+  expect (6 == call_0 (clone, "count"), "clone changes its data");
+  expect (5 == call_0 (vm, "count"), "clone leaves the original's data");
+  ts_load_string (clone, ":only-in-clone 42 ;");
+  expect (ts_not_found == ts_lookup (vm, "only-in-clone"),
+          "clone's definitions stay in the clone");
+  ts_vm_unmake (vm);
+  expect (42 == call_0 (clone, "only-in-clone")
+          && 6 == call_0 (clone, "count"),
+          "clone outlives its original");
+  ts_vm_unmake (clone);
+}
+
+
+/* Profiling */
+
+static int colon_calls;
+
+static int
+count_colon_call (ts_VM *vm, ts_Word *pw)
+{
+  ++colon_calls;
+  return 0;
+}
+
+/* Run the word named name with vm's output going to a temporary
+   file, and return what it wrote, to be freed by the caller. */
+static char *
+capture (ts_VM *vm, const char *name)
+{
+  FILE *f = tmpfile ();
+  long size;
+  char *text;
+  expect (NULL != f, "tmpfile");
+  ts_set_output_file_stream (vm, f, NULL);
+  expect (NULL == ts_call (vm, ts_word_handle (vm, name), NULL, 0, NULL, 0),
+          name);
+  ts_flush_output (vm);
+  ts_set_output_file_stream (vm, stdout, NULL);
+  size = ftell (f);
+  text = malloc (size + 1);
+  expect (NULL != text, "malloc");
+  rewind (f);
+  expect (size == (long) fread (text, 1, size, f), "fread");
+  text[size] = '\0';
+  fclose (f);
+  return text;
+}
+
+/* The profile names the words run, and hands the colon tracers back
+   when it stops. */
+static void
+check_profile (void)
+{
+  ts_VM *vm = make_vm ();
+  ts_Profile *prof = ts_install_profiler_words (vm);
+  char *text;
+  int calls;
+  expect (NULL != prof, "ts_install_profiler_words");
+  ts_load_string (vm, ":spin {n}  n 0= (unless)  n 1- spin ;"
+                      ":outer  1000000 spin  0 drop ;  :one  1 ;"
+                      ":report  profile-report ;"
+                      ":collapsed  profile-collapsed ;");
+  vm->colon_tracer = count_colon_call;
+  colon_calls = 0;
+  call_0 (vm, "one");
+  expect (1 == colon_calls, "a colon tracer of our own");
+
+  ts_profile_start (prof);
+  expect (NULL == ts_call (vm, ts_word_handle (vm, "outer"), NULL, 0,
+                           NULL, 0),
+          "outer");
+  ts_profile_stop (prof);
+  expect (count_colon_call == vm->colon_tracer
+          && NULL == vm->colon_exit_tracer && NULL == vm->colon_tracer_data,
+          "profile-stop restores the colon tracers");
+  calls = colon_calls;
+  call_0 (vm, "one");
+  expect (calls + 1 == colon_calls, "the old colon tracer runs again");
+  vm->colon_tracer = NULL;
+
+  text = capture (vm, "report");
+  expect (NULL != strstr (text, "1000001") && NULL != strstr (text, "spin"),
+          "profile-report counts calls");
+  free (text);
+  text = capture (vm, "collapsed");
+  expect (NULL != strstr (text, "outer;spin "),
+          "profile-collapsed names the words sampled");
+  free (text);
+  ts_profile_unmake (prof);
+  ts_vm_unmake (vm);
+}
+
+
+/* Tracing */
+
+/* Return what tracedump makes of the dump in filename, to be freed
+   by the caller. */
+static char *
+decode_trace (const char *filename)
+{
+  char command[128], *text = malloc (65536);
+  FILE *f;
+  size_t n;
+  expect (NULL != text, "malloc");
+  snprintf (command, sizeof command, "./tracedump %s", filename);
+  f = popen (command, "r");
+  expect (NULL != f, "popen tracedump");
+  n = fread (text, 1, 65535, f);
+  text[n] = '\0';
+  expect (0 == pclose (f), "tracedump");
+  return text;
+}
+
+/* Return how many lines of text end by naming the word name, or how
+   many lines there are if name is "". */
+static int
+count_lines_naming (const char *text, const char *name)
+{
+  int count = 0;
+  size_t n = strlen (name);
+  const char *line;
+  for (line = text; '\0' != *line; line = strchr (line, '\n') + 1)
+    {
+      const char *end = strchr (line, '\n');
+      if (0 == n
+          || (n < (size_t) (end - line) && ' ' == end[-n - 1]
+              && 0 == strncmp (end - n, name, n)))
+        ++count;
+    }
+  return count;
+}
+
+/* A trace keeps the last instructions run, and tracedump reads them
+   back; if the process dies, every trace gets dumped. */
+static void
+check_trace (void)
+{
+  ts_VM *vm = make_vm ();
+  ts_Trace *trace;
+  char filename[64], other[64], *text;
+  tsint hundred = 100;
+  pid_t pid;
+  int status;
+  snprintf (filename, sizeof filename, "/tmp/checkapi-trace.%d",
+            (int) getpid ());
+  snprintf (other, sizeof other, "/tmp/checkapi-trace2.%d",
+            (int) getpid ());
+  trace = ts_install_trace_words (vm, 16, 0, filename);
+  expect (NULL != trace, "ts_install_trace_words");
+  ts_load_string (vm, ":marked  4242 ;  :run-marked  marked drop ;"
+                      ":loop {n}  n 0= (unless)  n 1- loop ;");
+
+  ts_trace_start (trace);
+  expect (NULL == ts_call (vm, ts_word_handle (vm, "run-marked"), NULL, 0,
+                           NULL, 0),
+          "run-marked");
+  ts_trace_stop (trace);
+  expect (0 == ts_trace_dump (trace, filename), "ts_trace_dump");
+  text = decode_trace (filename);
+  expect (1 == count_lines_naming (text, "marked")
+          && 1 == count_lines_naming (text, "drop")
+          && NULL != strstr (text, " 4242 "),
+          "tracedump shows what ran");
+  free (text);
+
+  ts_trace_start (trace);
+  call_0 (vm, "marked");
+  expect (NULL == ts_call (vm, ts_word_handle (vm, "loop"), &hundred, 1,
+                           NULL, 0),
+          "loop");
+  ts_trace_stop (trace);
+  expect (0 == ts_trace_dump (trace, filename), "ts_trace_dump");
+  text = decode_trace (filename);
+  expect (0 == count_lines_naming (text, "marked")
+          && 0 < count_lines_naming (text, "loop")
+          && 1 + 16 == count_lines_naming (text, ""),
+          "the trace keeps only the latest records");
+  free (text);
+  remove (filename);
+
+  /* Two traces, on two VMs, both get dumped by ts_die(). */
+  fflush (NULL);
+  pid = fork ();
+  expect (0 <= pid, "fork");
+  if (0 == pid)
+    {
+      ts_VM *vm2 = make_vm ();
+      ts_Trace *trace2 = ts_install_trace_words (vm2, 16, 0, other);
+      freopen ("/dev/null", "w", stderr);
+      ts_trace_start (trace);
+      call_0 (vm, "marked");
+      ts_trace_start (trace2);
+      call_0 (vm2, "true");
+      ts_die ("dying on purpose");
+    }
+  expect (pid == waitpid (pid, &status, 0) && WIFEXITED (status)
+          && 1 == WEXITSTATUS (status),
+          "ts_die");
+  text = decode_trace (filename);
+  expect (1 == count_lines_naming (text, "marked"), "first trace dumped");
+  free (text);
+  text = decode_trace (other);
+  expect (1 == count_lines_naming (text, "true"), "second trace dumped");
+  free (text);
+  remove (filename);
+  remove (other);
+  ts_trace_unmake (trace);
+  ts_vm_unmake (vm);
+}
+
+
+/* Tasks */
+
+/* A task that finished after yielding from deep inside a catch gets
+   reused by one that fails just as deep down: the failure must come
+   back to whoever resumed it, with nothing left over from the first
+   task -- not its handlers, and not its call depth. */
+static void
+check_task_reuse (void)
+{
+  ts_VM *vm = make_vm ();
+  ts_Tasks *tasks = ts_install_task_words (vm, 0);
+  ts_VM_stats before, after;
+  int nest, trouble, resume_it;
+  tsint task;
+  const char *complaint;
+  expect (NULL != tasks, "ts_install_task_words");
+  ts_load_string (vm, ":down {n}  n 0= (if) yield ; (then)"
+                      "           n 1- down  0 drop ;"
+                      ":deep-yield  20 down ;"
+                      ":nest  'deep-yield catch drop ;"
+                      ":fail-down {n}  n 0= (if) \"task trouble\" error (then)"
+                      "                n 1- fail-down  0 drop ;"
+                      ":trouble  20 fail-down ;"
+                      ":resume-it {t}  t resume ;");
+  nest = ts_word_handle (vm, "nest");
+  trouble = ts_word_handle (vm, "trouble");
+  resume_it = ts_word_handle (vm, "resume-it");
+  task = ts_spawn (tasks, nest);
+  expect (NULL == ts_call (vm, resume_it, &task, 1, NULL, 0)
+          && NULL == ts_call (vm, resume_it, &task, 1, NULL, 0)
+          && ts_task_done (tasks, task),
+          "a task yielding inside a catch");
+  ts_vm_stats (vm, &before);
+  expect (task == ts_spawn (tasks, trouble), "a finished task gets reused");
+  complaint = ts_call (vm, resume_it, &task, 1, NULL, 0);
+  expect (NULL != complaint && NULL != strstr (complaint, "task trouble"),
+          "a reused task's error reaches its resumer");
+  ts_vm_stats (vm, &after);
+  expect (after.call_depth_peak == before.call_depth_peak,
+          "a reused task starts at the bottom of its stack");
+  expect (NULL == vm->handler_stack && 0 == vm->depth,
+          "a reused task leaves no handlers or depth behind");
+  task = ts_spawn (tasks, nest);
+  expect (NULL == ts_call (vm, resume_it, &task, 1, NULL, 0)
+          && NULL == ts_call (vm, resume_it, &task, 1, NULL, 0)
+          && ts_task_done (tasks, task),
+          "a task reused after an error");
+  ts_tasks_unmake (tasks);
+  ts_vm_unmake (vm);
+}
+
+
+/* Tasks doing I/O */
+
+/* A writer task sends more than a pipe holds while a reader task
+   drains it, so each has to wait on the other through run-tasks. */
+static void
+check_fd_tasks (void)
+{
+  ts_VM *vm = make_vm ();
+  ts_Tasks *tasks = ts_install_task_words (vm, 0);
+  int fds[2];
+  char source[512];
+  expect (NULL != tasks, "ts_install_task_words");
+  expect (0 == pipe (fds), "pipe");
+  snprintf (source, sizeof source,
+            ":got (here constant  0 , 0 ,)"
+            ":read-sum  got @ ;  :read-count  got cell+ @ ;"
+            ":write-n {n}  n 0= (if) ; (then)  65 emit  n 1- write-n ;"
+            ":read-n {n}  n 0= (if) ; (then)"
+            "             absorb got +!  1 got cell+ +!  n 1- read-n ;"
+            ":writer  %d fd-output  200000 write-n ;"
+            ":reader  %d fd-input  200000 read-n ;"
+            "('reader spawn drop  'writer spawn drop  run-tasks)",
+            fds[1], fds[0]);
+  ts_load_string (vm, source);
+  expect (200000 == call_0 (vm, "read-count")
+          && 65 * 200000 == call_0 (vm, "read-sum"),
+          "tasks pass bytes through a pipe");
+  ts_tasks_unmake (tasks);
+  close (fds[0]);
+  close (fds[1]);
+  ts_vm_unmake (vm);
+}
+
+
+/* A writer and a reader share one end of a socket through an echo
+   task on the other end, so both can be waiting on the same fd. */
+static void
+check_shared_fd (void)
+{
+  ts_VM *vm = make_vm ();
+  ts_Tasks *tasks = ts_install_task_words (vm, 0);
+  int fds[2];
+  char source[640];
+  expect (NULL != tasks, "ts_install_task_words");
+  expect (0 == socketpair (AF_UNIX, SOCK_STREAM, 0, fds), "socketpair");
+  snprintf (source, sizeof source,
+            ":got (here constant  0 , 0 ,)"
+            ":read-count  got cell+ @ ;"
+            ":write-n {n}  n 0= (if) ; (then)  66 emit  n 1- write-n ;"
+            ":read-n {n}  n 0= (if) ; (then)"
+            "             absorb got +!  1 got cell+ +!  n 1- read-n ;"
+            ":echo-n {n}  n 0= (if) ; (then)  absorb emit  n 1- echo-n ;"
+            ":writer  %d fd-output  500000 write-n ;"
+            ":reader  %d fd-input  500000 read-n ;"
+            ":echo  %d fd-input  %d fd-output  500000 echo-n ;"
+            "('writer spawn drop  'reader spawn drop  'echo spawn drop"
+            " run-tasks)",
+            fds[0], fds[0], fds[1], fds[1]);
+  ts_load_string (vm, source);
+  expect (500000 == call_0 (vm, "read-count"),
+          "a reader and a writer waiting on one fd");
+  ts_tasks_unmake (tasks);
+  close (fds[0]);
+  close (fds[1]);
+  ts_vm_unmake (vm);
+}
+
+
+/* Channels */
+
+enum { nmessages = 100000 };
+
+static void *
+spsc_producer (void *p)
+{
+  ts_Channel *chan = p;
+  char text[16];
+  int i;
+  for (i = 0; i < nmessages; ++i)
+    {
+      snprintf (text, sizeof text, "%d", i);
+      ts_channel_send (chan, i, text, strlen (text) + 1);
+    }
+  return NULL;
+}
+
+/* One sender and one receiver: everything arrives, in order. */
+static void
+check_spsc (void)
+{
+  ts_Channel *chan = ts_channel_make (16, 16, 0);
+  pthread_t thread;
+  char text[16], want[16];
+  int i;
+  expect (NULL != chan, "ts_channel_make");
+  expect (0 == pthread_create (&thread, NULL, spsc_producer, chan),
+          "pthread_create");
+  for (i = 0; i < nmessages; ++i)
+    {
+      tsint value;
+      int size = sizeof text;
+      ts_channel_recv (chan, &value, text, &size);
+      snprintf (want, sizeof want, "%d", i);
+      expect (i == value, "SPSC channel order");
+      expect ((int) strlen (want) + 1 == size && 0 == strcmp (text, want),
+              "SPSC channel payload");
+    }
+  pthread_join (thread, NULL);
+  {
+    tsint value;
+    int size = 0;
+    expect (!ts_channel_try_recv (chan, &value, NULL, &size),
+            "SPSC channel empty at the end");
+  }
+  ts_channel_unmake (chan);
+}
+
+enum { nproducers = 4, nconsumers = 4 };
+
+typedef struct Mpmc {
+  ts_Channel *chan;
+  int index;
+  unsigned char *seen;          /* # of times each message arrived */
+  long long sum;                /* Of the values this consumer got */
+} Mpmc;
+
+static void *
+mpmc_producer (void *p)
+{
+  Mpmc *m = p;
+  int i, per = nmessages / nproducers;
+  for (i = 0; i < per; ++i)
+    ts_channel_send (m->chan, m->index * per + i, NULL, 0);
+  return NULL;
+}
+
+static void *
+mpmc_consumer (void *p)
+{
+  Mpmc *m = p;
+  int i;
+  for (i = 0; i < nmessages / nconsumers; ++i)
+    {
+      tsint value;
+      int size = 0;
+      ts_channel_recv (m->chan, &value, NULL, &size);
+      if (0 <= value && value < nmessages)
+        ++m->seen[value];
+      m->sum += value;
+    }
+  return NULL;
+}
+
+/* Several of each: every message arrives exactly once. */
+static void
+check_mpmc (void)
+{
+  ts_Channel *chan = ts_channel_make (64, 0, ts_chan_multi_producer);
+  unsigned char *seen = calloc (nmessages, 1);
+  Mpmc producers[nproducers], consumers[nconsumers];
+  pthread_t threads[nproducers + nconsumers];
+  long long sum = 0;
+  int i;
+  expect (NULL != chan && NULL != seen, "ts_channel_make");
+  for (i = 0; i < nconsumers; ++i)
+    {
+      consumers[i].chan = chan, consumers[i].index = i;
+      consumers[i].seen = seen, consumers[i].sum = 0;
+      expect (0 == pthread_create (&threads[i], NULL, mpmc_consumer,
+                                   consumers + i),
+              "pthread_create");
+    }
+  for (i = 0; i < nproducers; ++i)
+    {
+      producers[i].chan = chan, producers[i].index = i;
+      expect (0 == pthread_create (&threads[nconsumers + i], NULL,
+                                   mpmc_producer, producers + i),
+              "pthread_create");
+    }
+  for (i = 0; i < nproducers + nconsumers; ++i)
+    pthread_join (threads[i], NULL);
+  for (i = 0; i < nconsumers; ++i)
+    sum += consumers[i].sum;
+  for (i = 0; i < nmessages; ++i)
+    expect (1 == seen[i], "MPMC channel delivers each message once");
+  expect ((long long) nmessages * (nmessages - 1) / 2 == sum,
+          "MPMC channel sum");
+  free (seen);
+  ts_channel_unmake (chan);
+}
+
+
+/* Worker pools */
+
+/* Jobs run on the workers' clones and report back by channel;
+   failures get counted. */
+static void
+check_pool (void)
+{
+  ts_VM *vm = make_vm ();
+  ts_Channel *chan = ts_channel_make (16, 0, ts_chan_multi_producer);
+  ts_Pool *pool;
+  long long sum = 0;
+  int i;
+  expect (NULL != chan, "ts_channel_make");
+  ts_install_channel_words (vm);
+  ts_install_channel (vm, "results", chan);
+  ts_load_string (vm, ":square {n}  n n *  results chan-send ;"
+                      ":refuse {n}  \"refused\" error ;");
+  pool = ts_pool_make (vm, 4);
+  expect (NULL != pool && 4 == ts_pool_size (pool), "ts_pool_make");
+  for (i = 0; i < 100; ++i)
+    expect (0 == ts_pool_submit (pool, ts_lookup (vm, "square"), i),
+            "ts_pool_submit");
+  for (i = 0; i < 100; ++i)
+    {
+      tsint value;
+      int size = 0;
+      ts_channel_recv (chan, &value, NULL, &size);
+      sum += value;
+    }
+  expect (0 == ts_pool_wait (pool), "pool jobs succeed");
+  expect (328350 == sum, "pool results");
+  for (i = 0; i < 3; ++i)
+    ts_pool_submit (pool, ts_lookup (vm, "refuse"), i);
+  expect (3 == ts_pool_wait (pool), "pool counts failed jobs");
+  expect (0 == ts_pool_wait (pool), "pool failure count resets");
+  ts_pool_unmake (pool);
+  ts_channel_unmake (chan);
+  ts_vm_unmake (vm);
+}
+
+
+int
+main (void)
+{
+  alarm (120);                  /* so a wedged task fails, not hangs */
+  check_cells ();
+  check_branches ();
+  check_stats ();
+  check_scratch ();
+  check_interning ();
+  check_call ();
+  check_foreign ();
+  check_clone ();
+  check_profile ();
+  check_trace ();
+  check_task_reuse ();
+  check_fd_tasks ();
+  check_shared_fd ();
+  check_spsc ();
+  check_mpmc ();
+  check_pool ();
+  printf ("ok\n");
+  return 0;
+}
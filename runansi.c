@@ -1,9 +1,11 @@
 #include <ctype.h>
 #include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "tusl.h"
@@ -20,13 +22,76 @@ enum { COLS = 80, ROWS = 37 }; // for now
 static char showing[ROWS][COLS];
 static char pending[ROWS][COLS];
 
+// The columns of each row where pending may differ from showing:
+// dirty_lo[y] up to dirty_hi[y], empty when the row is clean.
+static int dirty_lo[ROWS], dirty_hi[ROWS];
+
+// Frame pacing: when frame_ms is set, screen-refresh just asks for a
+// frame, drawn once frame_ms have passed since the last one or when
+// we're about to wait for input, whichever comes first.
+static int frame_ms;
+static int frame_wanted, want_x, want_y;
+static long long last_frame;    // When the last frame was drawn, in ms
+
+// Where the terminal's cursor is, or -1 if we can't be sure.
+static int at_x = -1, at_y = -1;
+
+// Output for the terminal, collected to go out in one write().
+static char frame[4096];
+static int frame_length;
+
+static void
+flush_frame(void) {
+    int i = 0;
+    fflush(stdout);             // anything printed before comes first
+    while (i < frame_length) {
+        ssize_t n = write(STDOUT_FILENO, frame + i, frame_length - i);
+        if (n < 0) {
+            if (errno != EINTR) panic();
+        } else
+            i += n;
+    }
+    frame_length = 0;
+}
+
+static void
+put(const char *s, int n) {
+    if ((int) sizeof frame - frame_length < n)
+        flush_frame();
+    memcpy(frame + frame_length, s, n);
+    frame_length += n;
+}
+
 static struct termios orig_termios;
+static int raw_mode;            // Whether we changed the terminal's settings
+
+static long long
+now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void
+mark_clean(int y) {
+    dirty_lo[y] = COLS;
+    dirty_hi[y] = 0;
+}
 
 static void
 setup(void) {
-    printf(ANSI "2J");  // clear, home
+    int y;
     memset(showing, ' ', sizeof showing);
     memset(pending, ' ', sizeof pending);
+    for (y = 0; y < ROWS; ++y)
+        mark_clean(y);
+    frame_wanted = 0;
+    put(ANSI "2J" ANSI "H", 7);  // clear, home
+    flush_frame();
+    at_x = at_y = 0;
+
+    // Not being on a terminal is OK, for measuring our output.
+    if (!isatty(STDIN_FILENO)) return;
 
     // TODO make this idempotent? (currently overwrites orig_termios)
     // from http://viewsourcecode.org/snaptoken/kilo/02.enteringRawMode.html
@@ -39,14 +104,20 @@ setup(void) {
     raw.c_cc[VMIN] = 0;
     raw.c_cc[VTIME] = 1;
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) panic();
+    raw_mode = 1;
 }
 
 static void
 teardown(void) {
-    printf(ANSI "2J");  // clear, home
+    frame_wanted = 0;           // no use drawing what we're about to clear
+    put(ANSI "2J" ANSI "H", 7);  // clear, home
+    flush_frame();
+    at_x = at_y = -1;
 
     // from http://viewsourcecode.org/snaptoken/kilo/02.enteringRawMode.html
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios) == -1) panic();
+    if (raw_mode && tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios) == -1)
+        panic();
+    raw_mode = 0;
 }
 
 static int
@@ -59,26 +130,109 @@ clip(int i, int limit) {
 static void
 blast(int x, int y, const char *buffer, int length) {
     int x1 = clip(x, COLS);
-    int y1 = clip(y, ROWS);
     int i, L = clip(length, COLS - x1);
-    for (i = 0; i < L; ++i)
-        pending[y1][x1 + i] = buffer[i];
+    if (y < 0 || ROWS <= y) return;
+    // Only what actually changes makes the row dirty, so blasting the
+    // same page again costs nothing at redisplay.
+    for (i = 0; i < L; ++i) {
+        if (pending[y][x1 + i] != buffer[i]) {
+            pending[y][x1 + i] = buffer[i];
+            if (x1 + i < dirty_lo[y]) dirty_lo[y] = x1 + i;
+            if (dirty_hi[y] <= x1 + i) dirty_hi[y] = x1 + i + 1;
+        }
+    }
+}
+
+// Append to s a relative move of n (> 0) in the direction of the
+// given final letter, returning the new end of s.
+static char *
+relative(char *s, int n, char dir) {
+    if (1 == n && 'B' == dir)
+        *s++ = '\n';            // (no OPOST, so no CR with it)
+    else if (1 == n)
+        s += sprintf(s, ANSI "%c", dir);
+    else
+        s += sprintf(s, ANSI "%d%c", n, dir);
+    return s;
+}
+
+// Move the terminal's cursor to (x, y) with the fewest bytes.
+static void
+move_to(int x, int y) {
+    char absolute[32], rel[32], *r = rel;
+    int alen = sprintf(absolute, ANSI "%d;%dH", y+1, x+1);
+    if (at_y < 0) {
+        put(absolute, alen);
+    } else if (at_x != x || at_y != y) {
+        if (y < at_y) r = relative(r, at_y - y, 'A');
+        if (at_y < y) r = relative(r, y - at_y, 'B');
+        if (0 == x && 0 != at_x) *r++ = '\r';
+        else if (at_x < x) r = relative(r, x - at_x, 'C');
+        else if (x < at_x) r = relative(r, at_x - x, 'D');
+        if (r - rel < alen) put(rel, r - rel);
+        else                put(absolute, alen);
+    }
+    at_x = x, at_y = y;
+}
+
+// A changed run of a row takes in any unchanged stretch short enough
+// that rewriting it is no longer than moving the cursor past it.
+enum { max_gap = 3 };
+
+// Return the end of the changed run of row y starting at x.
+static int
+run_end(int y, int x) {
+    int end = x + 1, i;
+    for (i = end; i < COLS && i - end < max_gap; ++i)
+        if (showing[y][i] != pending[y][i])
+            end = i + 1;
+    return end;
 }
 
+// Bring the terminal up to date with pending, sending just the
+// changed runs of each dirty row, all in one write().
 static void
 redisplay(int cursor_x, int cursor_y) {
-    int y;
-    printf(ANSI "H" ANSI "?25l"); // home, cursor-hide
+    int x, y, hidden = 0;
     for (y = 0; y < ROWS; ++y) {
-        if (0 != memcmp(showing[y], pending[y], COLS)) {
-            printf(ANSI "%d;1H", y+1); // goto(y+1, 1)
-            printf("%*.*s", COLS, COLS, pending[y]);
-            memcpy(showing[y], pending[y], COLS);
+        int hi = dirty_hi[y];
+        x = dirty_lo[y];
+        mark_clean(y);
+        while (x < hi) {
+            int end;
+            if (showing[y][x] == pending[y][x]) {
+                ++x;
+                continue;
+            }
+            if (!hidden) {
+                put(ANSI "?25l", 6);  // cursor-hide
+                hidden = 1;
+            }
+            end = run_end(y, x);
+            move_to(x, y);
+            put(pending[y] + x, end - x);
+            memcpy(showing[y] + x, pending[y] + x, end - x);
+            at_x = end;
+            if (COLS == at_x)   // the terminal may be about to wrap
+                at_x = at_y = -1;
+            x = end;
         }
     }
-    printf(ANSI "%d;%dH", cursor_y+1, cursor_x+1); // goto(...)
-    printf(ANSI "?25h");  // cursor-show
-    fflush(stdout);
+    move_to(clip(cursor_x, COLS - 1), clip(cursor_y, ROWS - 1));
+    if (hidden)
+        put(ANSI "?25h", 6);  // cursor-show
+    flush_frame();
+    frame_wanted = 0;
+    last_frame = now_ms();
+}
+
+// Ask for a frame with the cursor at (x, y); see frame_ms.
+static void
+refresh(int x, int y) {
+    want_x = x, want_y = y;
+    frame_wanted = 1;
+    if (0 == frame_ms || frame_ms <= now_ms() - last_frame)
+        redisplay(x, y);
 }
 
 static void
@@ -88,11 +242,39 @@ do_blast(ts_VM *vm, ts_Word *pw) {
     blast(w, x, ts_data_byte(vm, y), z);
 }
 
+// ( a n -- ) Blast each of the n records at a.  A record is 4 cells:
+// x, y, the address of the characters, and how many.
+static void
+do_blast_batch(ts_VM *vm, ts_Word *pw) {
+    ts_INPUT_2(vm, a, n);
+    const tsint *r;
+    int i;
+    if (n < 0) ts_error(vm, "Bad record count: %d", (int) n);
+    r = (const tsint *) ts_data_range(vm, a, n * 4 * sizeof r[0]);
+    for (i = 0; i < n; ++i, r += 4) {
+        int length = clip(r[3], COLS);
+        blast(r[0], r[1], ts_data_range(vm, r[2], length), length);
+    }
+    ts_OUTPUT_0();
+}
+
 static void
 do_refresh(ts_VM *vm, ts_Word *pw) {
     ts_INPUT_2(vm, y, z);
     ts_OUTPUT_0();
-    redisplay(y, z);
+    refresh(y, z);
+}
+
+// ( ms -- ) Draw frames at most every ms milliseconds, or whenever
+// input goes idle.  0 (the default) draws each refresh right away,
+// starting with any frame still wanted.
+static void
+do_frame_ms(ts_VM *vm, ts_Word *pw) {
+    ts_INPUT_1(vm, z);
+    ts_OUTPUT_0();
+    frame_ms = z < 0 ? 0 : z;
+    if (0 == frame_ms && frame_wanted)
+        redisplay(want_x, want_y);
 }
 
 static void
@@ -101,15 +283,56 @@ do_screen_size(ts_VM *vm, ts_Word *pw) {
     ts_OUTPUT_2(COLS, ROWS);
 }
 
+// Input bytes read ahead, in a ring buffer: a paste or a burst of
+// auto-repeat comes in with one read() instead of one per byte.
+enum { INPUT_SIZE = 4096 };     // a power of 2
+static unsigned char input[INPUT_SIZE];
+static unsigned input_head;     // Total # of bytes ever taken out
+static unsigned input_tail;     // Total # of bytes ever put in
+
+// Read as much as there's room for and is available, waiting for at
+// least one byte if wait is set.  Return the number read.
 static int
-get_byte(void) {
-    // from http://viewsourcecode.org/snaptoken/kilo/02.enteringRawMode.html
-    int nread;
-    char c;
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-        if (nread == -1 && errno != EAGAIN) panic();
+fill_input(int wait) {
+    unsigned at = input_tail & (INPUT_SIZE - 1);
+    unsigned room = INPUT_SIZE - (input_tail - input_head);
+    if (INPUT_SIZE - at < room) room = INPUT_SIZE - at;
+    if (0 == room) return 0;
+    for (;;) {
+        ssize_t nread;
+        if (!wait) {
+            struct pollfd p = { STDIN_FILENO, POLLIN, 0 };
+            if (poll(&p, 1, 0) <= 0) return 0;
+        }
+        // With VMIN=0, VTIME=1 this returns what's there, or 0 after
+        // 0.1 s of nothing.
+        nread = read(STDIN_FILENO, input + at, room);
+        if (0 < nread) {
+            input_tail += nread;
+            return nread;
+        }
+        if (nread == -1 && errno != EAGAIN && errno != EINTR) panic();
+        if (nread == 0 && !raw_mode) {
+            if (wait) ts_die("End of input");
+            return 0;
+        }
+        if (!wait) return 0;
     }
-    return (int) (unsigned char) c;
+}
+
+// Return true if there's input we can take without waiting.
+static int
+input_pending(void) {
+    return input_head != input_tail || 0 < fill_input(0);
+}
+
+static int
+get_byte(void) {
+    if (input_head == input_tail && frame_wanted && !input_pending())
+        redisplay(want_x, want_y);  // input's idle: catch the screen up
+    if (input_head == input_tail)
+        fill_input(1);
+    return input[input_head++ & (INPUT_SIZE - 1)];
 }
 
 static int
@@ -148,14 +371,32 @@ do_get_key(ts_VM *vm, ts_Word *pw) {
     ts_OUTPUT_1(c);
 }
 
+// ( a n -- u ) Wait for a key, then store it and any more that are
+// already typed, up to n in all, as cells at a.  Push how many.
+static void
+do_get_keys(ts_VM *vm, ts_Word *pw) {
+    ts_INPUT_2(vm, a, n);
+    tsint *keys;
+    int count = 0;
+    if (n < 0) ts_error(vm, "Bad key count: %d", (int) n);
+    keys = (tsint *) ts_data_range(vm, a, n * sizeof keys[0]);
+    if (0 < n)
+        do keys[count++] = get_key();
+        while (count < n && input_pending());
+    ts_OUTPUT_1(count);
+}
+
 static void
 install_curses_words(ts_VM *vm) {
-    ts_install(vm, "screen-setup",    ts_run_void_0, (tsint) setup);
-    ts_install(vm, "screen-teardown", ts_run_void_0, (tsint) teardown);
+    ts_install(vm, "screen-setup",    ts_run_void_0, (ts_Datum) setup);
+    ts_install(vm, "screen-teardown", ts_run_void_0, (ts_Datum) teardown);
     ts_install(vm, "screen-blast",    do_blast, 0);
+    ts_install(vm, "screen-blast-batch", do_blast_batch, 0);
     ts_install(vm, "screen-refresh",  do_refresh, 0);
+    ts_install(vm, "screen-frame-ms", do_frame_ms, 0);
     ts_install(vm, "screen-size",     do_screen_size, 0);
     ts_install(vm, "get-key",         do_get_key, 0);
+    ts_install(vm, "get-keys",        do_get_keys, 0);
 }
 
 int
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <curses.h>
 
@@ -13,6 +14,28 @@ panic (void)
   ts_die (strerror (errno));
 }
 
+/* We draw in screen and read keys from stdscr, so that getch() never
+   shows a half-drawn frame: it refreshes stdscr, which stays blank. */
+static WINDOW *screen;
+
+/* Whether anything was drawn in screen since the last frame */
+static int dirty;
+
+/* Frame pacing: when frame_ms is set, screen-refresh just asks for a
+   frame, drawn once frame_ms have passed since the last one or when
+   we're about to wait for a key, whichever comes first. */
+static int frame_ms;
+static int frame_wanted, want_x, want_y;
+static long long last_frame;    /* When the last frame was drawn, in ms */
+
+static long long
+now_ms (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
 static void
 setup (void)
 {
@@ -22,11 +45,20 @@ setup (void)
   nonl ();
   intrflush (stdscr, FALSE);
   keypad (stdscr, TRUE);
+  refresh ();                   /* so getch() finds stdscr up to date */
+  screen = newwin (LINES, COLS, 0, 0);
+  if (NULL == screen)
+    panic ();
+  dirty = 1;
+  frame_wanted = 0;
 }
 
 static void
 teardown (void)
 {
+  delwin (screen);
+  screen = NULL;
+  frame_wanted = 0;
   endwin ();
 }
 
@@ -43,17 +75,64 @@ blast (int x, int y, const char *buffer, int length)
 {
   int x1 = clip (x, COLS);
   int y1 = clip (y, LINES);
-  int i, L = length;  /* clip (length, COLS - x1); */
-  move (y1, x1);
-  for (i = 0; i < L; ++i)
-    addch (buffer[i]);
+  if (0 < length)       /* (not clipped to COLS - x1: it wraps) */
+    mvwaddnstr (screen, y1, x1, buffer, length);
+  dirty = 1;
 }
 
+/* Curses itself keeps track of the changed parts of each line, so
+   all we skip is a frame with nothing new at all. */
 static void
 redisplay (int cursor_x, int cursor_y)
 {
-  move (clip (cursor_y, LINES), clip (cursor_x, COLS));
-  refresh ();
+  int x = clip (cursor_x, COLS - 1), y = clip (cursor_y, LINES - 1);
+  int cx, cy;
+  if (NULL == screen)
+    return;
+  getyx (screen, cy, cx);
+  if (dirty || cx != x || cy != y)
+    {
+      wmove (screen, y, x);
+      wrefresh (screen);
+    }
+  dirty = 0;
+  frame_wanted = 0;
+  last_frame = now_ms ();
+}
+
+/* Ask for a frame with the cursor at (x, y); see frame_ms. */
+static void
+request_frame (int x, int y)
+{
+  want_x = x, want_y = y;
+  frame_wanted = 1;
+  if (0 == frame_ms || frame_ms <= now_ms () - last_frame)
+    redisplay (x, y);
+}
+
+/* Return the next key if one is already typed, else ERR. */
+static int
+key_now (void)
+{
+  int c;
+  nodelay (stdscr, TRUE);
+  c = getch ();
+  nodelay (stdscr, FALSE);
+  return c;
+}
+
+/* Wait for a key, first drawing any frame wanted if none is typed. */
+static int
+get_key (void)
+{
+  if (frame_wanted)
+    {
+      int c = key_now ();
+      if (ERR != c)
+        return c;
+      redisplay (want_x, want_y);
+    }
+  return getch ();
 }
 
 static void
@@ -64,12 +143,44 @@ do_blast (ts_VM *vm, ts_Word *pw)
   blast (w, x, ts_data_byte (vm, y), z);
 }
 
+/* ( a n -- ) Blast each of the n records at a.  A record is 4 cells:
+   x, y, the address of the characters, and how many. */
+static void
+do_blast_batch (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  const tsint *r;
+  int i;
+  if (n < 0)
+    ts_error (vm, "Bad record count: %d", (int) n);
+  r = (const tsint *) ts_data_range (vm, a, n * 4 * sizeof r[0]);
+  for (i = 0; i < n; ++i, r += 4)
+    {
+      int length = r[3] < 0 ? 0 : r[3];
+      blast (r[0], r[1], ts_data_range (vm, r[2], length), length);
+    }
+  ts_OUTPUT_0 ();
+}
+
 static void
 do_refresh (ts_VM *vm, ts_Word *pw)
 {
   ts_INPUT_2 (vm, y, z);
   ts_OUTPUT_0 ();
-  redisplay (y, z);
+  request_frame (y, z);
+}
+
+/* ( ms -- ) Draw frames at most every ms milliseconds, or whenever
+   input goes idle.  0 (the default) draws each refresh right away,
+   starting with any frame still wanted. */
+static void
+do_frame_ms (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_1 (vm, z);
+  ts_OUTPUT_0 ();
+  frame_ms = z < 0 ? 0 : z;
+  if (0 == frame_ms && frame_wanted)
+    redisplay (want_x, want_y);
 }
 
 static void
@@ -79,15 +190,43 @@ do_screen_size (ts_VM *vm, ts_Word *pw)
   ts_OUTPUT_2 (COLS, LINES);
 }
 
+/* ( a n -- u ) Wait for a key, then store it and any more that are
+   already typed, up to n in all, as cells at a.  Push how many. */
+static void
+do_get_keys (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  tsint *keys;
+  int count = 0;
+  if (n < 0)
+    ts_error (vm, "Bad key count: %d", (int) n);
+  keys = (tsint *) ts_data_range (vm, a, n * sizeof keys[0]);
+  if (0 < n)
+    {
+      keys[count++] = get_key ();
+      while (count < n)
+        {
+          int c = key_now ();
+          if (ERR == c)
+            break;
+          keys[count++] = c;
+        }
+    }
+  ts_OUTPUT_1 (count);
+}
+
 static void
 install_curses_words (ts_VM *vm)
 {
-  ts_install (vm, "screen-setup",    ts_run_void_0, (tsint) setup);
-  ts_install (vm, "screen-teardown", ts_run_void_0, (tsint) teardown);
+  ts_install (vm, "screen-setup",    ts_run_void_0, (ts_Datum) setup);
+  ts_install (vm, "screen-teardown", ts_run_void_0, (ts_Datum) teardown);
   ts_install (vm, "screen-blast",    do_blast, 0);
+  ts_install (vm, "screen-blast-batch", do_blast_batch, 0);
   ts_install (vm, "screen-refresh",  do_refresh, 0);
   ts_install (vm, "screen-size",     do_screen_size, 0);
-  ts_install (vm, "get-key",         ts_run_int_0, (tsint) getch);
+  ts_install (vm, "screen-frame-ms", do_frame_ms, 0);
+  ts_install (vm, "get-key",         ts_run_int_0, (ts_Datum) get_key);
+  ts_install (vm, "get-keys",        do_get_keys, 0);
 }
 
 int
@@ -26,6 +26,9 @@ file_exists (const char *filename)
 int
 main (int argc, char **argv)
 {
+  ts_Tasks *tasks;
+  ts_Profile *profile;
+  ts_Trace *trace;
   ts_VM *vm = ts_vm_make ();
   if (NULL == vm)
     panic ();
@@ -33,6 +36,19 @@ main (int argc, char **argv)
   ts_set_input_file_stream (vm, stdin, NULL);
   ts_install_standard_words (vm);
   ts_install_unsafe_words (vm);
+  tasks = ts_install_task_words (vm, 0);
+  if (NULL == tasks)
+    panic ();
+  ts_install_parallel_words (vm, 0);
+  ts_install_array_words (vm);
+  ts_install_hash_words (vm);
+  profile = ts_install_profiler_words (vm);
+  if (NULL == profile)
+    panic ();
+  trace = ts_install_trace_words (vm, 16384, ts_trace_timestamps, 
+                                  "tusl-trace.bin");
+  if (NULL == trace)
+    panic ();
   
   // XXX refactor ts_load so you can pass in a FILE*
   if (file_exists ("tuslrc.ts"))
@@ -40,6 +56,9 @@ main (int argc, char **argv)
   else
     ts_load (vm, "/usr/local/share/tusl/tuslrc.ts");
 
+  /* Keep string literals typed at the top level from piling up. */
+  ts_set_scratch_pad (vm, 4096);
+
   if (1 == argc)
     ts_load_interactive (vm, stdin);
   else
@@ -49,6 +68,9 @@ main (int argc, char **argv)
         ts_load_string (vm, argv[i]);
     }
 
+  ts_trace_unmake (trace);
+  ts_profile_unmake (profile);
+  ts_tasks_unmake (tasks);
   ts_vm_unmake (vm);
   return 0;
 }
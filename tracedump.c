@@ -0,0 +1,111 @@
+/* TUSL -- the ultimate scripting language.
+   Copyright 2003-2005 Darius Bacon under the terms of the MIT X license
+   found at http://www.opensource.org/licenses/mit-license.html */
+
+/* Decode a trace dumped by tusltrace.c into text, one line per
+   instruction, oldest first.  Usage: tracedump [-n last-n] file */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusl.h"
+
+static void
+panic (const char *filename)
+{
+  fprintf (stderr, "%s: %s\n", filename,
+           errno ? strerror (errno) : "Not a TUSL trace");
+  exit (1);
+}
+
+static uint32_t
+get_u32 (FILE *fp, const char *filename)
+{
+  uint32_t u;
+  if (1 != fread (&u, sizeof u, 1, fp))
+    panic (filename);
+  return u;
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *filename;
+  char magic[8];
+  char **names;
+  uint32_t size, n, nnames, flags, i, skip;
+  unsigned long last = 0;
+  unsigned long long prev_ns = 0;
+  FILE *fp;
+
+  if (4 == argc && 0 == strcmp (argv[1], "-n"))
+    {
+      last = strtoul (argv[2], NULL, 10);
+      argv += 2, argc -= 2;
+    }
+  if (2 != argc)
+    {
+      fprintf (stderr, "Usage: %s [-n last-n] trace-file\n", argv[0]);
+      return 1;
+    }
+  filename = argv[1];
+  fp = fopen (filename, "rb");
+  if (NULL == fp)
+    panic (filename);
+  errno = 0;
+  if (1 != fread (magic, sizeof magic, 1, fp)
+      || 0 != memcmp (magic, "TUSLTRC1", sizeof magic))
+    panic (filename);
+  size = get_u32 (fp, filename);
+  n = get_u32 (fp, filename);
+  nnames = get_u32 (fp, filename);
+  flags = get_u32 (fp, filename);
+  if (sizeof (ts_Trace_record) != size)
+    {
+      fprintf (stderr, "%s: written by an incompatible build\n", filename);
+      return 1;
+    }
+  skip = 0 < last && last < n ? n - last : 0;
+
+  names = calloc (nnames, sizeof names[0]);
+  if (NULL == names)
+    panic (filename);
+  for (i = 0; i < nnames; ++i)
+    {
+      uint16_t length;
+      if (1 != fread (&length, sizeof length, 1, fp))
+        panic (filename);
+      names[i] = malloc (length + 1);
+      if (NULL == names[i]
+          || length != fread (names[i], 1, length, fp))
+        panic (filename);
+      names[i][length] = '\0';
+    }
+
+  printf ("%10s %5s %5s %6s %20s  %s%s\n", "step", "depth", "sp", "pc",
+          "top", (flags & ts_trace_timestamps) ? "+ns  " : "", "word");
+  for (i = 0; i < n; ++i)
+    {
+      ts_Trace_record r;
+      if (1 != fread (&r, sizeof r, 1, fp))
+        panic (filename);
+      if (i < skip)
+        {
+          prev_ns = r.ns;
+          continue;
+        }
+      printf ("%10u %5d %5d %6d %20lld  ", i, r.depth, r.sp, r.pc, r.top);
+      if (flags & ts_trace_timestamps)
+        printf ("%-5llu", 0 == prev_ns ? 0 : r.ns - prev_ns);
+      prev_ns = r.ns;
+      if (r.word < nnames && '\0' != names[r.word][0])
+        printf ("%s\n", names[r.word]);
+      else
+        printf ("#%u\n", r.word);
+    }
+  fclose (fp);
+  return 0;
+}
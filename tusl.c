@@ -4,6 +4,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -71,11 +72,36 @@ print_place (char **dest, int *dest_size, const ts_Place *place)
 
 /* Exceptions */
 
+static ts_DieFn *die_fn = NULL;
+static void *die_data = NULL;
+
+/* Arrange for fn(data) to be called by ts_die() just before exiting,
+   replacing any earlier such arrangement.  Pass a null fn to cancel. */
+void
+ts_on_die (ts_DieFn *fn, void *data)
+{
+  die_fn = fn;
+  die_data = data;
+}
+
+/* Cancel the arrangement ts_on_die(fn, data) made, unless it's
+   already been replaced by another. */
+void
+ts_cancel_on_die (ts_DieFn *fn, void *data)
+{
+  if (die_fn == fn && die_data == data)
+    ts_on_die (NULL, NULL);
+}
+
 /* Complain and terminate the process. */
 void
 ts_die (const char *plaint)
 {
+  ts_DieFn *fn = die_fn;
   fprintf (stderr, "%s\n", plaint);
+  die_fn = NULL;                /* In case fn dies too */
+  if (NULL != fn)
+    fn (die_data);
   exit (1);
 }
 
@@ -132,6 +158,10 @@ ts_error (ts_VM *vm, const char *message, ...)
 
 /* Misc VM operations */
 
+/* Floats travel on the stack as their bit patterns. */
+static INLINE tsfloat i2f (tsint i) { return *(tsfloat*)&i; }
+static INLINE tsint f2i (tsfloat f) { return *(tsint*)&f; }
+
 /* Return the index of the top of vm's stack. */
 static INLINE int
 stack_pointer (ts_VM *vm)
@@ -146,6 +176,14 @@ data_cell (ts_VM *vm, int i)
   return (tsint *)ts_data_byte (vm, i);
 }
 
+/* Return a native pointer to the code unit at index i in vm's data
+   space. */
+static INLINE ts_Code *
+code_at (ts_VM *vm, int i)
+{
+  return (ts_Code *)ts_data_byte (vm, i);
+}
+
 /* Return the first cell boundary at or after n. */
 static INLINE int
 cell_align (int n)
@@ -167,6 +205,19 @@ ensure_space (ts_VM *vm, size_t size)
     ts_error (vm, "Out of space");
 }
 
+/* Allot size bytes of vm's data area, cell-aligned, and return the
+   index of the first. */
+int
+ts_reserve (ts_VM *vm, int size)
+{
+  int start;
+  align_here (vm);
+  ensure_space (vm, size);
+  start = vm->here;
+  vm->here += size;
+  return start;
+}
+
 /* Append a tsint to vm's data area. */
 static void
 compile (ts_VM *vm, tsint c)
@@ -177,6 +228,17 @@ compile (ts_VM *vm, tsint c)
   vm->here += sizeof c;
 }
 
+/* Append a unit of code (an instruction or part of an operand) to
+   vm's data area. */
+static void
+compile_code (ts_VM *vm, ts_Code c)
+{
+  vm->here = (vm->here + sizeof c - 1) & ~(int)(sizeof c - 1);
+  ensure_space (vm, sizeof c);
+  *code_at (vm, vm->here) = c;
+  vm->here += sizeof c;
+}
+
 /* Prepend string to vm's string area, returning its index in data space. */
 static int
 compile_string (ts_VM *vm, const char *string)
@@ -188,6 +250,43 @@ compile_string (ts_VM *vm, const char *string)
   return vm->there;
 }
 
+/* Return the index of a string equal to `string' already in vm's
+   string space (outside the scratch pad), or else compile a new copy. */
+static int
+intern_string (ts_VM *vm, const char *string)
+{
+  int i = vm->there;
+  while (i < ts_data_size)
+    {
+      if (i == vm->scratch && 0 < vm->scratch_size)
+        {
+          i += vm->scratch_size;
+          continue;
+        }
+      const char *s = vm->data + i;
+      int size = strnlen (s, ts_data_size - i) + 1;
+      if (0 == strcmp (s, string))
+        return i;
+      i += size;
+    }
+  return compile_string (vm, string);
+}
+
+/* Copy an interpret-mode string literal into the scratch pad if
+   we're reading a top-level command and it fits, or else into string
+   space for good.  Return its index in data space. */
+static int
+scratch_string (ts_VM *vm, const char *string)
+{
+  int size = strlen (string) + 1;
+  int start = vm->scratch + vm->scratch_used;
+  if (!vm->in_command || vm->scratch_size - vm->scratch_used < size)
+    return compile_string (vm, string);
+  memcpy (vm->data + start, string, size);
+  vm->scratch_used += size;
+  return start;
+}
+
 /* Return a copy of s allocated in vm's string space. */
 static char *
 save_string (ts_VM *vm, const char *s)
@@ -471,7 +570,8 @@ enum {
   GRAB6,
   WILL,
   DO_WILL,
-  LAST_SPECIAL_PRIM = DO_WILL
+  SHORT_LITERAL,       /* Dictionary index of "<<short-literal>>" */
+  LAST_SPECIAL_PRIM = SHORT_LITERAL
 };
 
 enum { max_locals = 6 };
@@ -502,7 +602,7 @@ ts_lookup (ts_VM *vm, const char *name)
 /* Add a word named `name' to vm's dictionary.  The name is not copied,
    so you shouldn't reuse its characters for anything else. */
 void
-ts_install (ts_VM *vm, char *name, ts_Action *action, tsint datum)
+ts_install (ts_VM *vm, char *name, ts_Action *action, ts_Datum datum)
 {
   if (ts_dictionary_size <= vm->where + vm->local_words)
     ts_error (vm, "Too many words");
@@ -519,6 +619,14 @@ ts_install (ts_VM *vm, char *name, ts_Action *action, tsint datum)
   }
 }
 
+/* Forget the current set of local variables. */
+static void
+reset_locals (ts_VM *vm, ts_Word *pw)
+{
+  vm->local_words = 0;
+  vm->local_names_ptr = 0;
+}
+
 /* Add 'name' to the current set of local variables. */
 static void
 install_local (ts_VM *vm, const char *name)
@@ -548,22 +656,66 @@ install_local (ts_VM *vm, const char *name)
 
 /* VM creation/destruction and special primitives */
 
-/* Primitive to push a literal value. */
+/* Primitive to push a literal value, the cell following in the code. */
 static void
 ts_do_literal (ts_VM *vm, ts_Word *pw)
 {
   ts_INPUT_0 (vm); 
-  ts_OUTPUT_1 (vm->pc++[0]); 
+  tsint c;
+  memcpy (&c, vm->pc, sizeof c);
+  vm->pc += sizeof c / sizeof vm->pc[0];
+  ts_OUTPUT_1 (c); 
 }
 
+/* Primitive to push a literal value that fits in one (signed) 16-bit
+   code unit.  Only compact code uses this. */
+static void
+ts_do_short_literal (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_0 (vm); 
+  ts_OUTPUT_1 ((short) vm->pc++[0]); 
+}
+
+#ifdef TS_COMPACT_CODE
+/* A branch operand is the distance to the target in code units,
+   counting from the operand itself.  Since the data area is at most
+   64K bytes, 16 bits always reach. */
+static INLINE ts_Code *
+branch_target (ts_VM *vm, ts_Code *operand)
+{
+  return code_at (vm, (char *)operand - vm->data 
+                      + (short) *operand * (int) sizeof *operand);
+}
+
+static INLINE ts_Code
+branch_operand (int operand, int target)
+{
+  return (ts_Code) ((target - operand) / (int) sizeof (ts_Code));
+}
+#else
+/* A branch operand is the target's index in data space. */
+static INLINE ts_Code *
+branch_target (ts_VM *vm, ts_Code *operand)
+{
+  return code_at (vm, *operand);
+}
+
+static INLINE ts_Code
+branch_operand (int operand, int target)
+{
+  return target;
+}
+#endif
+
 /* Primitive to pop, then jump if zero. */
 void
 ts_do_branch (ts_VM *vm, ts_Word *pw) 
 {
   ts_INPUT_1 (vm, z);
-  tsint y = vm->pc++[0];
   if (0 == z)
-    vm->pc = data_cell (vm, y);
+    vm->pc = branch_target (vm, vm->pc);
+  else
+    ++vm->pc;
   ts_OUTPUT_0 ();
 }
 
@@ -600,6 +752,11 @@ ts_vm_make (void)
   vm->where = 0;
   vm->local_words = 0;
   vm->mode = '(';
+  vm->scratch = 0;
+  vm->scratch_size = 0;
+  vm->scratch_used = 0;
+  vm->in_command = no;
+  vm->intern_strings = no;
   ts_disable_IO (vm);
   vm->token_place = vm->input.place;
   vm->error = default_error;
@@ -608,7 +765,18 @@ ts_vm_make (void)
   vm->tracer_data = NULL;
   vm->colon_tracer = NULL;
   vm->colon_tracer_data = NULL;
+  vm->colon_exit_tracer = NULL;
   vm->handler_stack = NULL;
+  vm->depth = 0;
+  vm->sp_peak = vm->sp;
+  vm->here_peak = vm->here;
+  vm->there_peak = vm->there;
+  vm->where_peak = 0;
+  vm->depth_peak = 0;
+  vm->nloads = 0;
+  memset (&vm->loaded, 0, sizeof vm->loaded);
+  memset (vm->heap_free, 0, sizeof vm->heap_free);
+  memset (vm->heap_map, 0, sizeof vm->heap_map);
 
   /* Internals depend on the order of these first definitions;
      see enums above. */
@@ -629,6 +797,7 @@ ts_vm_make (void)
   ts_install (vm, "uvwxyz-",      NULL, 0);
   ts_install (vm, ";will",        NULL, 0);
   ts_install (vm, "<<will>>",     ts_do_will, 0);
+  ts_install (vm, "<<short-literal>>", ts_do_short_literal, 0);
   /* XXX I should initialize the actions of all remaining dictionary
      entries to an undefined_word() action... or at least null them
      out.  Though the 'where check' in do_sequence() makes running an
@@ -638,18 +807,99 @@ ts_vm_make (void)
   return vm;
 }
 
+/* If p points into the size bytes at from, return the corresponding
+   pointer into to; else return p unchanged. */
+static char *
+relocate (char *p, const char *from, char *to, size_t size)
+{
+  if ((size_t)(p - from) < size)
+    return to + (p - from);
+  return p;
+}
+
+/* Return a newly malloc'd copy of original, or NULL if out of memory.
+   The copy gets its own stack, data area, and dictionary, initialized
+   from original's, so the two may go their separate ways afterwards.
+   Its I/O streams talk to the same sources and sinks as original's,
+   but start out with nothing buffered.  The copy starts out idle,
+   with no instruction sequence running and no exception handlers,
+   even if original was in the middle of something.  It isn't traced:
+   tracers belong to the VM they were set on.  Its high-water marks
+   start out at its current levels, not original's.  (The ts_on_die()
+   hook is per process, so there's none to reset here.) */
+ts_VM *
+ts_vm_clone (ts_VM *original)
+{
+  ts_VM *vm = malloc (sizeof *vm);
+  if (NULL == vm)
+    return NULL;
+
+  /* The VM is one contiguous block with only a handful of internal
+     pointers, so a flat copy plus fixups is all it takes. */
+  memcpy (vm, original, sizeof *vm);
+  {
+    int i;
+    for (i = 0; i < ts_dictionary_size; ++i)
+      {
+        ts_Word *w = vm->words + i;
+        if (vm->where <= i && i < ts_dictionary_size - vm->local_words)
+          continue;             /* not in use */
+        if (NULL == w->name)
+          continue;
+        w->name = relocate (w->name, original->data, vm->data,
+                            sizeof vm->data);
+        w->name = relocate (w->name, original->local_names, vm->local_names,
+                            sizeof vm->local_names);
+      }
+  }
+  vm->pc = NULL;
+  vm->handler_stack = NULL;
+  vm->depth = 0;
+  vm->sp_peak = vm->sp;
+  vm->here_peak = vm->here;
+  vm->there_peak = vm->there;
+  vm->where_peak = vm->where;
+  vm->depth_peak = 0;
+  vm->tracer = NULL;
+  vm->tracer_data = NULL;
+  vm->colon_tracer = NULL;
+  vm->colon_exit_tracer = NULL;
+  vm->colon_tracer_data = NULL;
+  ts_set_stream (&vm->input, original->input.streamer, original->input.data,
+                 original->input.place.opt_filename);
+  vm->input.place = original->input.place;
+  ts_set_stream (&vm->output, original->output.streamer,
+                 original->output.data, original->output.place.opt_filename);
+  return vm;
+}
+
 /* Compile a literal value to be pushed at runtime. */
 static void
 compile_push (ts_VM *vm, tsint c)
 {
-  compile (vm, LITERAL);
-  compile (vm, c);
+  ts_Code units[sizeof c / sizeof (ts_Code)];
+  int i;
+#ifdef TS_COMPACT_CODE
+  if ((short) c == c)
+    {
+      compile_code (vm, SHORT_LITERAL);
+      compile_code (vm, (ts_Code) c);
+      return;
+    }
+#endif
+  compile_code (vm, LITERAL);
+  memcpy (units, &c, sizeof c);
+  for (i = 0; i < (int) (sizeof units / sizeof units[0]); ++i)
+    compile_code (vm, units[i]);
 }
 
 
 /* Primitives */
 
-/* Execute a colon definition. */
+/* Execute a colon definition.  If there's a colon_tracer, it sees
+   every definition we start running, including by a tail call, and
+   the colon_exit_tracer sees every one of those we leave, including
+   by an exception. */
 static void 
 do_sequence (ts_VM *vm, ts_Word *pw) 
 {
@@ -657,8 +907,11 @@ do_sequence (ts_VM *vm, ts_Word *pw)
     return;
   {
     tsint locals[max_locals];
-    tsint *old_pc = vm->pc;
-    vm->pc = data_cell (vm, pw->datum);
+    ts_Code *old_pc = vm->pc;
+    ts_Word *volatile running = pw; /* Changes on tail calls */
+    vm->pc = code_at (vm, pw->datum);
+    if (vm->depth_peak < ++(vm->depth))
+      vm->depth_peak = vm->depth;
 
     {                    /* TODO: eliminate overhead of setjmp here */
       ts_TRY (vm, frame)
@@ -698,10 +951,16 @@ do_sequence (ts_VM *vm, ts_Word *pw)
                   ts_Action *action = vm->words[word].action;
                   if (do_sequence == action && EXIT == vm->pc[0])
                     {           /* tail call */
+                      if (NULL != vm->colon_exit_tracer)
+                        vm->colon_exit_tracer (vm, running);
+                      running = &(vm->words[word]);
                       if (NULL != vm->colon_tracer && 
-                          vm->colon_tracer (vm, pw))
-                        return;
-                      vm->pc = data_cell (vm, vm->words[word].datum);
+                          vm->colon_tracer (vm, running))
+                        {
+                          running = NULL;
+                          break;
+                        }
+                      vm->pc = code_at (vm, running->datum);
                     }
                   else
                     action (vm, &(vm->words[word]));
@@ -711,11 +970,17 @@ do_sequence (ts_VM *vm, ts_Word *pw)
             }
 
           vm->pc = old_pc;
+          --(vm->depth);
           ts_POP_TRY (vm, frame);
+          if (NULL != vm->colon_exit_tracer && NULL != running)
+            vm->colon_exit_tracer (vm, running);
         }
       ts_EXCEPT (vm, frame)
         {
           vm->pc = old_pc;
+          --(vm->depth);
+          if (NULL != vm->colon_exit_tracer && NULL != running)
+            vm->colon_exit_tracer (vm, running);
           ts_escape (vm, frame.complaint);
         }
     }
@@ -773,6 +1038,100 @@ ts_run (ts_VM *vm, tsint word)
   } while (0);
 }
 
+/* Return a handle for calling the word named name with ts_call(), or
+   ts_not_found.  It's good until the word is forgotten. */
+int
+ts_word_handle (ts_VM *vm, const char *name)
+{
+  int word = ts_lookup (vm, name);
+  if ((unsigned)word <= LAST_SPECIAL_PRIM)
+    return ts_not_found;
+  return word;
+}
+
+/* Run one call of a batch, inside the caller's exception frame: push
+   the arguments all at once, run, and pop the results, topmost last.
+   Any extra results are dropped. */
+static void
+call_one (ts_VM *vm, int base, int handle, const tsint *args, int nargs,
+          tsint *results, int nresults)
+{
+  int top = base / (int)sizeof vm->stack[0];
+  if (ts_stack_size - 1 - top < nargs || nargs < 0)
+    ts_error (vm, "Stack overflow");
+  memcpy (vm->stack + top + 1, args, nargs * sizeof args[0]);
+  vm->sp = base + nargs * sizeof vm->stack[0];
+  if (vm->sp_peak < vm->sp)
+    vm->sp_peak = vm->sp;
+  ts_run (vm, handle);
+  if (stack_pointer (vm) - top < nresults)
+    ts_error (vm, "Expected %d results, got %d", 
+              nresults, stack_pointer (vm) - top);
+  memcpy (results, vm->stack + stack_pointer (vm) + 1 - nresults, 
+          nresults * sizeof results[0]);
+  vm->sp = base;
+}
+
+/* Call the word with the given handle, passing it nargs arguments
+   (args[0] deepest) and collecting nresults results (topmost last).
+   Return NULL on success, or else the complaint that was raised.  The
+   stack is left as it was either way.  (A complaint may live in data
+   space, so use it before compiling anything more.) */
+const char *
+ts_call (ts_VM *vm, int handle, const tsint *args, int nargs,
+         tsint *results, int nresults)
+{
+  int base = vm->sp;
+  ts_TRY (vm, frame)
+    {
+      call_one (vm, base, handle, args, nargs, results, nresults);
+      ts_POP_TRY (vm, frame);
+      return NULL;
+    }
+  ts_EXCEPT (vm, frame)
+    {
+      vm->sp = base;
+      return frame.complaint;
+    }
+  return NULL;                  /* not reached */
+}
+
+/* Make each of the calls in turn, like ts_call() but setting up the
+   exception frame only once unless a call fails.  Each call's
+   complaint is set to "" or a copy of its complaint -- a copy, since
+   the next failure would overwrite the original in data space.
+   Return the number of calls that failed. */
+int
+ts_call_batch (ts_VM *vm, ts_Call *calls, int ncalls)
+{
+  int base = vm->sp;
+  volatile int i = 0, failures = 0;
+  while (i < ncalls)
+    {
+      ts_TRY (vm, frame)
+        {
+          for (; i < ncalls; ++i)
+            {
+              ts_Call *c = calls + i;
+              call_one (vm, base, c->handle, c->args, c->nargs,
+                        c->results, c->nresults);
+              c->complaint[0] = '\0';
+            }
+          ts_POP_TRY (vm, frame);
+        }
+      ts_EXCEPT (vm, frame)
+        {
+          vm->sp = base;
+          strncpy (calls[i].complaint, frame.complaint,
+                   sizeof calls[i].complaint - 1);
+          calls[i].complaint[sizeof calls[i].complaint - 1] = '\0';
+          ++failures;
+          ++i;
+        }
+    }
+  return failures;
+}
+
 /* The behavior of a word whose action was set by ;will. */
 static void
 ts_do_will (ts_VM *vm, ts_Word *pw)
@@ -801,17 +1160,30 @@ ts_do_will (ts_VM *vm, ts_Word *pw)
 #define define2(name, code) \
   void name (ts_VM *vm, ts_Word *pw) { ts_INPUT_2 (vm, y, z); code }
 
+/* Return the native address of data index i as a cell, if it fits. */
+static tsint
+data_pointer (ts_VM *vm, tsint i)
+{
+  ts_Datum p = (ts_Datum) ts_data_byte (vm, i);
+  if ((tsint) p != p)
+    ts_error (vm, "Native address doesn't fit in a cell");
+  return (tsint) p;
+}
+
 define0 (ts_do_push,      ts_OUTPUT_1 (pw->datum); )
 
 define1 (ts_make_literal, ts_OUTPUT_0 (); compile_push (vm, z); )
 define1 (ts_execute,      ts_OUTPUT_0 (); ts_run (vm, z); )
-define1 (ts_to_data,      ts_OUTPUT_1 ((tsint) ts_data_byte (vm, z)); )
+define1 (ts_to_data,      ts_OUTPUT_1 (data_pointer (vm, z)); )
 define1 (ts_comma,        ts_OUTPUT_0 (); compile (vm, z); )
+define1 (ts_resolve,      ts_OUTPUT_0 (); 
+                          *code_at (vm, z) = branch_operand (z, vm->here); )
 define1 (ts_allot,        ts_OUTPUT_0 (); ensure_space (vm, z); vm->here += z;)
 define0 (ts_align_bang,   ts_OUTPUT_0 (); align_here (vm); )
 define0 (ts_here,         ts_OUTPUT_1 (vm->here); )
 define0 (ts_there,        ts_OUTPUT_1 (vm->there); )
 define0 (ts_where,        ts_OUTPUT_1 (vm->where); )
+define1 (ts_scratch_pad,  ts_OUTPUT_0 (); ts_set_scratch_pad (vm, z); )
 define1 (ts_string_comma, ts_OUTPUT_1 (compile_string (vm, 
                                                        ts_data_byte (vm, 
                                                                      z))); )
@@ -841,11 +1213,12 @@ define2 (ts_lshift,       ts_OUTPUT_1 (y << z); )
 define2 (ts_rshift,       ts_OUTPUT_1 (y >> z); )
 define2 (ts_urshift,      ts_OUTPUT_1 ((tsuint)y >> (tsuint)z); )
 
-define1 (ts_fetchu,       ts_OUTPUT_1 (*(tsint *)z); )
-define1 (ts_cfetchu,      ts_OUTPUT_1 (*(unsigned char *)z); )
-define2 (ts_storeu,       ts_OUTPUT_0 (); *(int *)z = y; )
-define2 (ts_cstoreu,      ts_OUTPUT_0 (); *(unsigned char *)z = y; )
-define2 (ts_plus_storeu,  ts_OUTPUT_0 (); *(int *)z += y; )
+/* The unsafe words take native addresses, as from >data. */
+define1 (ts_fetchu,       ts_OUTPUT_1 (*(tsint *)(ts_Datum)z); )
+define1 (ts_cfetchu,      ts_OUTPUT_1 (*(unsigned char *)(ts_Datum)z); )
+define2 (ts_storeu,       ts_OUTPUT_0 (); *(int *)(ts_Datum)z = y; )
+define2 (ts_cstoreu,      ts_OUTPUT_0 (); *(unsigned char *)(ts_Datum)z = y; )
+define2 (ts_plus_storeu,  ts_OUTPUT_0 (); *(int *)(ts_Datum)z += y; )
 
 define1 (ts_fetch,        ts_OUTPUT_1 (*data_cell (vm, z)); )
 define1 (ts_cfetch,       ts_OUTPUT_1 (*(unsigned char*)ts_data_byte (vm, z)); )
@@ -890,12 +1263,353 @@ ts_make_constant (ts_VM *vm, ts_Word *pw)
   w->datum = z;
 }
 
+/* Bring the high-water marks for vm's dictionary and data area up to
+   date, as we must before they shrink. */
+static void
+note_peaks (ts_VM *vm)
+{
+  if (vm->here_peak < vm->here)
+    vm->here_peak = vm->here;
+  if (vm->there < vm->there_peak)
+    vm->there_peak = vm->there;
+  if (vm->where_peak < vm->where)
+    vm->where_peak = vm->where;
+}
+
+/* Fill in stats with how much of vm's space is in use and the most
+   that's been used. */
+void
+ts_vm_stats (ts_VM *vm, ts_VM_stats *stats)
+{
+  note_peaks (vm);
+  stats->stack_cells = stack_pointer (vm) + 1;
+  stats->stack_cells_peak = vm->sp_peak / (int)sizeof vm->stack[0] + 1;
+  stats->code_bytes = vm->here;
+  stats->code_bytes_peak = vm->here_peak;
+  stats->string_bytes = ts_data_size - vm->there;
+  stats->string_bytes_peak = ts_data_size - vm->there_peak;
+  stats->words = vm->where;
+  stats->words_peak = vm->where_peak;
+  stats->call_depth = vm->depth;
+  stats->call_depth_peak = vm->depth_peak;
+  stats->nloads = vm->nloads;
+  stats->loads = vm->loads;
+}
+
+/* (A limit of 0 means none is fixed.) */
+static void
+put_memory_line (ts_VM *vm, const char *what, int used, int peak, int limit)
+{
+  char line[80], lim[16] = "-";
+  if (0 < limit)
+    sprintf (lim, "%d", limit);
+  ts_put_string (vm, line, sprintf (line, "%-10s %9d %9d %9s\n",
+                                    what, used, peak, lim));
+}
+
+/* Print a table of vm's space usage, with a breakdown by file loaded. */
+static void
+ts_print_memory (ts_VM *vm, ts_Word *pw)
+{
+  ts_VM_stats st;
+  char line[120];
+  int i;
+  ts_INPUT_0 (vm);
+  ts_OUTPUT_0 ();
+  ts_vm_stats (vm, &st);
+  ts_put_string (vm, line, sprintf (line, "%-10s %9s %9s %9s\n",
+                                    "", "in use", "peak", "limit"));
+  put_memory_line (vm, "stack", st.stack_cells, st.stack_cells_peak, 
+                   ts_stack_size);
+  put_memory_line (vm, "code", st.code_bytes, st.code_bytes_peak, 
+                   ts_data_size);
+  put_memory_line (vm, "strings", st.string_bytes, st.string_bytes_peak, 
+                   ts_data_size);
+  put_memory_line (vm, "words", st.words, st.words_peak, ts_dictionary_size);
+  put_memory_line (vm, "calls", st.call_depth, st.call_depth_peak, 0);
+  if (0 < st.nloads)
+    ts_put_string (vm, line, sprintf (line, "%-28s %5s %6s %7s %7s\n",
+                                      "file", "loads", "words", 
+                                      "code", "strings"));
+  for (i = 0; i < st.nloads; ++i)
+    {
+      const ts_Load_stats *ls = st.loads + i;
+      ts_put_string (vm, line, sprintf (line, "%-28s %5d %6d %7d %7d\n",
+                                        ls->filename, ls->loads, ls->words,
+                                        ls->code_bytes, ls->string_bytes));
+    }
+}
+
+/* The heap.  Blocks get carved off at here, in power-of-2 sizes from
+   32 bytes up, and go on a free list by size when freed, for reuse
+   by the next allocation of that size.  Each block starts with an
+   info cell packing its size class, whether it's in use, and the
+   number of bytes asked for.  The first cell of a free block's
+   payload links it to the next free block of its size.  Index 0 is
+   never a block, so it serves as the null link.
+
+   All of that is in data space, where a script can overwrite it, so
+   vm->heap_map keeps the truth out of reach: for each cell where a
+   block starts, its size class + 1, plus map_used while it's in use.
+   Every block address that comes in gets checked against the map.
+   Since blocks only come from here, forget can drop the ones it
+   passes with no trouble. */
+
+enum { min_block = 32, block_header = sizeof (tsint) };
+enum { tag_used = 0xa5, tag_free = 0x5a };
+enum { map_used = 0x80 };
+
+static tsint
+block_info (int requested, int tag, int class)
+{
+  return ((tsint) requested << 12) | (tag << 4) | class;
+}
+
+static int info_class (tsint info)     { return info & 15; }
+static int info_tag (tsint info)       { return (info >> 4) & 255; }
+static int info_requested (tsint info) { return info >> 12; }
+
+/* Return the size class of a block for size bytes of payload. */
+static int
+size_class (ts_VM *vm, int size)
+{
+  int class = 0;
+  if (size < 0 || ts_data_size < size)
+    ts_error (vm, "Bad allocation size: %d", size);
+  while ((min_block << class) < size + (int)block_header)
+    ++class;
+  if (ts_heap_classes <= class)
+    ts_error (vm, "Bad allocation size: %d", size);
+  return class;
+}
+
+/* Return vm's heap_map entry for block, or 0 if it can't be one. */
+static int
+map_entry (ts_VM *vm, int block)
+{
+  if (block <= 0 || ts_data_size <= block || 0 != block % sizeof (tsint))
+    return 0;
+  return vm->heap_map[block / sizeof (tsint)];
+}
+
+/* Return the index of the block whose payload is at addr, checking
+   it's in use and its info cell agrees with the heap map. */
+static int
+used_block (ts_VM *vm, int addr)
+{
+  int block = addr - block_header;
+  int entry = map_entry (vm, block);
+  int class = (entry & ~map_used) - 1;
+  tsint info;
+  if (!(entry & map_used))
+    ts_error (vm, "Not an allocated block: %d", addr);
+  info = data_cell (vm, block)[0];
+  if (tag_used != info_tag (info) || class != info_class (info)
+      || info_requested (info) < 0
+      || (min_block << class) - (int)block_header < info_requested (info))
+    ts_error (vm, "Heap block clobbered: %d", addr);
+  return block;
+}
+
+/* Allot a block with room for size bytes and return the index of
+   its payload. */
+int
+ts_allocate (ts_VM *vm, int size)
+{
+  int class = size_class (vm, size);
+  int block = vm->heap_free[class];
+  if (0 != block)
+    {
+      if (class + 1 != map_entry (vm, block))
+        ts_error (vm, "Heap free list clobbered: %d", block);
+      vm->heap_free[class] = data_cell (vm, block)[1];
+    }
+  else
+    block = ts_reserve (vm, min_block << class);
+  vm->heap_map[block / sizeof (tsint)] = (class + 1) | map_used;
+  data_cell (vm, block)[0] = block_info (size, tag_used, class);
+  return block + block_header;
+}
+
+/* Free the block whose payload is at addr. */
+void
+ts_free (ts_VM *vm, int addr)
+{
+  int block = used_block (vm, addr);
+  tsint *header = data_cell (vm, block);
+  int class = info_class (header[0]);
+  vm->heap_map[block / sizeof (tsint)] = class + 1;
+  header[0] = block_info (0, tag_free, class);
+  header[1] = vm->heap_free[class];
+  vm->heap_free[class] = block;
+}
+
+/* Return the payload index of a block with room for size bytes,
+   holding as much of the contents of the one at addr as fits: the
+   same one, if it's big enough.  An addr of 0 means no block yet. */
+int
+ts_resize (ts_VM *vm, int addr, int size)
+{
+  int block, class, old_size, new_addr;
+  if (0 == addr)
+    return ts_allocate (vm, size);
+  block = used_block (vm, addr);
+  class = info_class (data_cell (vm, block)[0]);
+  old_size = info_requested (data_cell (vm, block)[0]);
+  if (size_class (vm, size) == class)
+    {
+      data_cell (vm, block)[0] = block_info (size, tag_used, class);
+      return addr;
+    }
+  new_addr = ts_allocate (vm, size);
+  memcpy (vm->data + new_addr, vm->data + addr, 
+          old_size < size ? old_size : size);
+  ts_free (vm, addr);
+  return new_addr;
+}
+
+/* Drop the heap blocks at or past here, after a forget, and relink
+   the free lists from the map. */
+static void
+forget_heap (ts_VM *vm)
+{
+  int i, n = ts_data_size / sizeof (tsint);
+  int first_gone = (vm->here + sizeof (tsint) - 1) / sizeof (tsint);
+  memset (vm->heap_map + first_gone, 0, n - first_gone);
+  memset (vm->heap_free, 0, sizeof vm->heap_free);
+  for (i = first_gone - 1; 0 < i; --i)
+    {
+      int entry = vm->heap_map[i];
+      if (0 != entry && !(entry & map_used))
+        {
+          int block = i * sizeof (tsint), class = entry - 1;
+          data_cell (vm, block)[1] = vm->heap_free[class];
+          vm->heap_free[class] = block;
+        }
+    }
+}
+
+/* Fill in stats by walking vm's heap map. */
+void
+ts_heap_stats (ts_VM *vm, ts_Heap_stats *stats)
+{
+  int i;
+  memset (stats, 0, sizeof *stats);
+  for (i = 1; i < (int) (ts_data_size / sizeof (tsint)); ++i)
+    {
+      int entry = vm->heap_map[i];
+      int class, size;
+      if (0 == entry)
+        continue;
+      class = (entry & ~map_used) - 1;
+      size = min_block << class;
+      ++stats->blocks[class];
+      if (!(entry & map_used))
+        {
+          ++stats->free_blocks[class];
+          stats->free += size;
+        }
+      else
+        {
+          stats->in_use += size;
+          stats->requested += 
+            info_requested (data_cell (vm, i * sizeof (tsint))[0]);
+        }
+    }
+}
+
+define1 (ts_allocate_prim, ts_OUTPUT_1 (ts_allocate (vm, z)); )
+define1 (ts_free_prim,     ts_OUTPUT_0 (); ts_free (vm, z); )
+define2 (ts_resize_prim,   ts_OUTPUT_1 (ts_resize (vm, y, z)); )
+
+/* Print a table of vm's heap usage by block size. */
+static void
+ts_print_heap (ts_VM *vm, ts_Word *pw)
+{
+  ts_Heap_stats st;
+  char line[80];
+  int class;
+  ts_INPUT_0 (vm);
+  ts_OUTPUT_0 ();
+  ts_heap_stats (vm, &st);
+  ts_put_string (vm, line, sprintf (line, "%9s %9s %9s\n", 
+                                    "size", "blocks", "free"));
+  for (class = 0; class < ts_heap_classes; ++class)
+    if (0 < st.blocks[class])
+      ts_put_string (vm, line, sprintf (line, "%9d %9d %9d\n",
+                                        min_block << class, 
+                                        st.blocks[class], 
+                                        st.free_blocks[class]));
+  ts_put_string (vm, line, 
+                 sprintf (line, "in use %d bytes (%d asked for), free %d\n",
+                          st.in_use, st.requested, st.free));
+}
+
+/* Record in marker how far vm's dictionary and data area extend now. */
+void
+ts_mark (ts_VM *vm, ts_Marker *marker)
+{
+  marker->where = vm->where;
+  marker->here = vm->here;
+  marker->there = vm->there;
+}
+
+/* Throw away all the words, data, and strings added to vm since
+   marker was taken, along with any locals being defined. */
+void
+ts_forget (ts_VM *vm, const ts_Marker *marker)
+{
+  if (vm->where < marker->where || vm->here < marker->here 
+      || marker->there < vm->there || marker->where <= LAST_SPECIAL_PRIM)
+    ts_error (vm, "Stale marker");
+  note_peaks (vm);
+  vm->where = marker->where;
+  vm->here = marker->here;
+  vm->there = marker->there;
+  if (vm->scratch < vm->there)
+    vm->scratch_size = 0;       /* the pad went with the rest */
+  forget_heap (vm);
+  reset_locals (vm, NULL);
+}
+
+/* The behavior of a word made by 'marker': forget everything since. */
+static void
+ts_do_marker (ts_VM *vm, ts_Word *pw)
+{
+  ts_Marker marker;
+  marker.where = data_cell (vm, pw->datum)[0];
+  marker.here  = data_cell (vm, pw->datum)[1];
+  marker.there = data_cell (vm, pw->datum)[2];
+  ts_forget (vm, &marker);
+}
+
+/* Change the last-defined word so that running it forgets every
+   word, datum, and string defined after it (but not itself). */
+void
+ts_make_marker (ts_VM *vm, ts_Word *pw)
+{
+  ts_Word *w = vm->words + vm->where - 1;
+  int snapshot;
+  ts_INPUT_0 (vm);
+  ts_OUTPUT_0 ();
+  align_here (vm);
+  ensure_space (vm, 3 * sizeof (tsint));
+  snapshot = vm->here;
+  vm->here += 3 * sizeof (tsint);
+  data_cell (vm, snapshot)[0] = vm->where;
+  data_cell (vm, snapshot)[1] = vm->here;
+  data_cell (vm, snapshot)[2] = vm->there;
+  w->action = ts_do_marker;
+  w->datum = snapshot;
+}
+
 /* Given a name, define a new word (as a colon definition). */
 void
 ts_create (ts_VM *vm, ts_Word *pw)
 {
   ts_INPUT_1 (vm, z);
   ts_OUTPUT_0 ();
+  align_here (vm);
   ts_install (vm, ts_data_byte (vm, z), do_sequence, vm->here);
 }
 
@@ -924,16 +1638,23 @@ static void
 compile_grab (ts_VM *vm, ts_Word *pw)
 {
   if (0 < vm->local_words)
-    compile (vm, GRAB1 + vm->local_words - 1);
+    compile_code (vm, GRAB1 + vm->local_words - 1);
 }
 
+/* Append a unit of code: an instruction, or a piece of the operand
+   of the one before, like the 0 that `if' leaves for `then' to
+   resolve. */
 static void
-reset_locals (ts_VM *vm, ts_Word *pw)
+ts_compile_comma (ts_VM *vm, ts_Word *pw)
 {
-  vm->local_words = 0;
-  vm->local_names_ptr = 0;
+  ts_INPUT_1 (vm, z);
+  ts_OUTPUT_0 ();
+  if ((ts_Code) z != z)
+    ts_error (vm, "Too big for a unit of code: %ld", (long) z);
+  compile_code (vm, z);
 }
 
+
 /* Print vm's stack as decimal numbers to vm's output. */
 void
 ts_print_stack (ts_VM *vm, ts_Word *pw)
@@ -973,24 +1694,27 @@ parse_number (tsint *result, const char *text)
 {
   char *endptr;
   tsint value;
+  long svalue;
+  unsigned long uvalue;
 
   if ('\0' == text[0])
     return no;
 
+  /* The range checks matter when cells are narrower than longs. */
   errno = 0;
-  value = strtol (text, &endptr, 0);
-  if (!all_blank (endptr) || ERANGE == errno)
+  value = svalue = strtol (text, &endptr, 0);
+  if (!all_blank (endptr) || ERANGE == errno || value != svalue)
     {
       errno = 0;
-      value = strtoul (text, &endptr, 0);
-      if ('\0' != *endptr || ERANGE == errno)
+      value = uvalue = strtoul (text, &endptr, 0);
+      if ('\0' != *endptr || ERANGE == errno || (tsuint) value != uvalue)
 	{
 	  /* Ugly hack to more or less support float constants */
 	  tsfloat fvalue;
 	  errno = 0, fvalue = (tsfloat) strtod (text, &endptr);
 	  if (!all_blank (endptr) || ERANGE == errno)
 	    return no;
-	  value = *(tsint *)&fvalue;
+	  value = f2i (fvalue);
 	}
     }
 
@@ -1117,9 +1841,6 @@ ts_run_int_4 (ts_VM *vm, ts_Word *pw)
 /* Floating-point primitives.  These are easy to misuse since floats
    get mixed with ints on the stack without any typechecking. */
 
-static INLINE tsfloat i2f (tsint i) { return *(tsfloat*)&i; }
-static INLINE tsint f2i (tsfloat f) { return *(tsint*)&f; }
-
 define2 (ts_fadd, ts_OUTPUT_1 (f2i (i2f (y) + i2f (z))); )
 define2 (ts_fsub, ts_OUTPUT_1 (f2i (i2f (y) - i2f (z))); )
 define2 (ts_fmul, ts_OUTPUT_1 (f2i (i2f (y) * i2f (z))); )
@@ -1128,6 +1849,41 @@ define2 (ts_fdiv, ts_OUTPUT_1 (f2i (i2f (y) / i2f (z))); )
 define1 (ts_fprint, ts_OUTPUT_0 (); 
 	            put_double (vm, i2f (z)); ts_put_char (vm, ' '); )
 
+define2 (ts_fless,         ts_OUTPUT_1 (-(i2f (y) < i2f (z))); )
+define2 (ts_fgreater,      ts_OUTPUT_1 (-(i2f (y) > i2f (z))); )
+define2 (ts_fless_eq,      ts_OUTPUT_1 (-(i2f (y) <= i2f (z))); )
+define2 (ts_fgreater_eq,   ts_OUTPUT_1 (-(i2f (y) >= i2f (z))); )
+define2 (ts_fequal,        ts_OUTPUT_1 (-(i2f (y) == i2f (z))); )
+define1 (ts_fis_negative,  ts_OUTPUT_1 (-(i2f (z) < 0)); )
+define1 (ts_fis_zero,      ts_OUTPUT_1 (-(i2f (z) == 0)); )
+
+define1 (ts_int_to_float,  ts_OUTPUT_1 (f2i ((tsfloat) z)); )
+define1 (ts_float_to_int,  ts_OUTPUT_1 ((tsint) i2f (z)); )
+
+define1 (ts_fnegate,       ts_OUTPUT_1 (f2i (-i2f (z))); )
+define1 (ts_fabs,          ts_OUTPUT_1 (f2i (fabs (i2f (z)))); )
+define1 (ts_ffloor,        ts_OUTPUT_1 (f2i (floor (i2f (z)))); )
+define1 (ts_fround,        ts_OUTPUT_1 (f2i (round (i2f (z)))); )
+define1 (ts_fsqrt,         ts_OUTPUT_1 (f2i (sqrt (i2f (z)))); )
+define1 (ts_fexp,          ts_OUTPUT_1 (f2i (exp (i2f (z)))); )
+define1 (ts_flog,          ts_OUTPUT_1 (f2i (log (i2f (z)))); )
+define1 (ts_fsin,          ts_OUTPUT_1 (f2i (sin (i2f (z)))); )
+define1 (ts_fcos,          ts_OUTPUT_1 (f2i (cos (i2f (z)))); )
+define1 (ts_ftan,          ts_OUTPUT_1 (f2i (tan (i2f (z)))); )
+define1 (ts_fatan,         ts_OUTPUT_1 (f2i (atan (i2f (z)))); )
+define2 (ts_fatan2,        ts_OUTPUT_1 (f2i (atan2 (i2f (y), i2f (z)))); )
+define2 (ts_fpow,          ts_OUTPUT_1 (f2i (pow (i2f (y), i2f (z)))); )
+define2 (ts_fmin,          ts_OUTPUT_1 (f2i (fmin (i2f (y), i2f (z)))); )
+define2 (ts_fmax,          ts_OUTPUT_1 (f2i (fmax (i2f (y), i2f (z)))); )
+
+/* ( x y z -- x*y+z ), rounded once */
+static void
+ts_ffma (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, x, y, z);
+  ts_OUTPUT_1 (f2i (fma (i2f (x), i2f (y), i2f (z))));
+}
+
 
 /* Add all the safe built-in primitives to vm's dictionary. */
 void
@@ -1159,12 +1915,21 @@ ts_install_standard_words (ts_VM *vm)
 
   ts_install (vm, "literal",      ts_make_literal, 0);
   ts_install (vm, ",",            ts_comma, 0);
+  ts_install (vm, "compile,",     ts_compile_comma, 0);
+  ts_install (vm, "resolve",      ts_resolve, 0);
   ts_install (vm, "here",         ts_here, 0);
   ts_install (vm, "there",        ts_there, 0);
   ts_install (vm, "where",        ts_where, 0);
+  ts_install (vm, "scratch-pad",  ts_scratch_pad, 0);
   ts_install (vm, "allot",        ts_allot, 0);
   ts_install (vm, "align!",       ts_align_bang, 0);
   ts_install (vm, "constant",     ts_make_constant, 0);
+  ts_install (vm, "marker",       ts_make_marker, 0);
+  ts_install (vm, ".memory",      ts_print_memory, 0);
+  ts_install (vm, "allocate",     ts_allocate_prim, 0);
+  ts_install (vm, "free",         ts_free_prim, 0);
+  ts_install (vm, "resize",       ts_resize_prim, 0);
+  ts_install (vm, ".heap",        ts_print_heap, 0);
   ts_install (vm, "create",       ts_create, 0);
   ts_install (vm, "create-local", ts_create_local, 0);
   ts_install (vm, "reset-locals", reset_locals, 0);
@@ -1194,6 +1959,31 @@ ts_install_standard_words (ts_VM *vm)
   ts_install (vm, "f*",           ts_fmul, 0);
   ts_install (vm, "f/",           ts_fdiv, 0);
   ts_install (vm, "f.",           ts_fprint, 0);
+  ts_install (vm, "f<",           ts_fless, 0);
+  ts_install (vm, "f>",           ts_fgreater, 0);
+  ts_install (vm, "f<=",          ts_fless_eq, 0);
+  ts_install (vm, "f>=",          ts_fgreater_eq, 0);
+  ts_install (vm, "f=",           ts_fequal, 0);
+  ts_install (vm, "f0<",          ts_fis_negative, 0);
+  ts_install (vm, "f0=",          ts_fis_zero, 0);
+  ts_install (vm, "i>f",          ts_int_to_float, 0);
+  ts_install (vm, "f>i",          ts_float_to_int, 0);
+  ts_install (vm, "fnegate",      ts_fnegate, 0);
+  ts_install (vm, "fabs",         ts_fabs, 0);
+  ts_install (vm, "ffloor",       ts_ffloor, 0);
+  ts_install (vm, "fround",       ts_fround, 0);
+  ts_install (vm, "fsqrt",        ts_fsqrt, 0);
+  ts_install (vm, "fexp",         ts_fexp, 0);
+  ts_install (vm, "flog",         ts_flog, 0);
+  ts_install (vm, "fsin",         ts_fsin, 0);
+  ts_install (vm, "fcos",         ts_fcos, 0);
+  ts_install (vm, "ftan",         ts_ftan, 0);
+  ts_install (vm, "fatan",        ts_fatan, 0);
+  ts_install (vm, "fatan2",       ts_fatan2, 0);
+  ts_install (vm, "f**",          ts_fpow, 0);
+  ts_install (vm, "fmin",         ts_fmin, 0);
+  ts_install (vm, "fmax",         ts_fmax, 0);
+  ts_install (vm, "ffma",         ts_ffma, 0);
 
   /* Extras for efficiency */
   ts_install (vm, "0<",           ts_is_negative, 0);
@@ -1353,11 +2143,13 @@ dispatch (ts_VM *vm, const char *token)
 
     case '"':                   /* a string literal */
     case '`':
-      {
-        int string_index = compile_string (vm, token + 1);
-        ('(' == vm->mode ? ts_push : compile_push) (vm, string_index);
-        break;
-      }
+      if ('(' == vm->mode)
+        ts_push (vm, scratch_string (vm, token + 1));
+      else if (vm->intern_strings)
+        compile_push (vm, intern_string (vm, token + 1));
+      else
+        compile_push (vm, compile_string (vm, token + 1));
+      break;
 
     case '\'':                  /* a tick literal */
       {
@@ -1383,7 +2175,12 @@ dispatch (ts_VM *vm, const char *token)
         {                       /* handle it if it's a defined word */
           int word = ts_lookup (vm, token);
           if (ts_not_found != word)
-            ('(' == vm->mode ? ts_run : compile) (vm, word);
+            {
+              if ('(' == vm->mode)
+                ts_run (vm, word);
+              else
+                compile_code (vm, word);
+            }
           else
             {         /* handle it if it's a literal number */
               tsint value;
@@ -1399,6 +2196,53 @@ dispatch (ts_VM *vm, const char *token)
 
 /* Input loading */
 
+/* What a top-level command started out with, so we know when
+   nothing can still be using its scratch strings. */
+typedef struct Command_mark {
+  int sp;
+  int scratch_used;
+  char nested;                  /* Run from within another command? */
+} Command_mark;
+
+static void
+begin_command (ts_VM *vm, Command_mark *mark)
+{
+  mark->sp = vm->sp;
+  mark->scratch_used = vm->scratch_used;
+  mark->nested = vm->in_command;
+  vm->in_command = yes;
+}
+
+/* Take back the scratch pad once the command ends, unless it left
+   something new on the stack that could be one of its strings.  (A
+   string stored away with ! or , from interpret mode at the top level
+   still gets reclaimed -- use string, for anything that should stick
+   around.  Files loaded by the command don't use the pad.) */
+static void
+end_command (ts_VM *vm, const Command_mark *mark)
+{
+  vm->in_command = mark->nested;
+  if (vm->sp <= mark->sp)
+    vm->scratch_used = mark->nested ? mark->scratch_used : 0;
+}
+
+/* Give interpret-mode string literals in top-level commands (each
+   ts_load_string() call, or each line of the interactive loop) a
+   scratch pad of size bytes, carved out of string space, that gets
+   reused by the next command.  A size of 0 stops using the pad; its
+   space isn't given back. */
+void
+ts_set_scratch_pad (ts_VM *vm, int size)
+{
+  if (size < 0)
+    ts_error (vm, "Bad scratch pad size: %d", size);
+  ensure_space (vm, size);
+  vm->there -= size;
+  vm->scratch = vm->there;
+  vm->scratch_size = size;
+  vm->scratch_used = 0;
+}
+
 /* Print a prompt with the current mode and stack height. */
 static void
 prompt (ts_VM *vm)
@@ -1422,9 +2266,11 @@ void
 ts_interactive_loop (ts_VM *vm)
 {
   char token[1024];
+  Command_mark mark;
   vm->mode = '(';
 
   prompt (vm);
+  begin_command (vm, &mark);
   for (;;)
     {
       ts_TRY (vm, frame)
@@ -1435,7 +2281,11 @@ ts_interactive_loop (ts_VM *vm)
               break;
             }
           else if ('\n' == token[0])
-            prompt (vm);
+            {
+              end_command (vm, &mark);
+              prompt (vm);
+              begin_command (vm, &mark);
+            }
           else
             dispatch (vm, token);
           ts_POP_TRY (vm, frame);
@@ -1447,7 +2297,9 @@ ts_interactive_loop (ts_VM *vm)
           ts_put_string (vm, frame.complaint, strlen (frame.complaint));
           ts_put_char (vm, '\n');
           discard_input (vm);
+          end_command (vm, &mark);
           prompt (vm);
+          begin_command (vm, &mark);
         }
     }
 
@@ -1474,6 +2326,7 @@ with_io_on_file (ts_VM *vm,
 {
   ts_Stream input = vm->input;
   ts_Stream output = vm->output;
+  char in_command = vm->in_command;
   FILE *fp = fopen (filename, mode);
   if (NULL == fp)
     ts_error (vm, "%s: %s\n", filename, strerror (errno));
@@ -1483,6 +2336,7 @@ with_io_on_file (ts_VM *vm,
         ts_set_input_file_stream (vm, fp, filename);
       else
         ts_set_output_file_stream (vm, fp, filename);
+      vm->in_command = no;
       {
         ts_TRY (vm, frame)
           {
@@ -1491,6 +2345,7 @@ with_io_on_file (ts_VM *vm,
             fclose (fp);
             vm->output = output;
             vm->input = input;
+            vm->in_command = in_command;
             ts_POP_TRY (vm, frame);
           }
         ts_EXCEPT (vm, frame)
@@ -1498,6 +2353,7 @@ with_io_on_file (ts_VM *vm,
             fclose (fp);
             vm->output = output;
             vm->input = input;
+            vm->in_command = in_command;
             ts_escape (vm, frame.complaint);
           }
       }
@@ -1516,6 +2372,43 @@ ts_with_io_on_file (ts_VM *vm, ts_Word *pw)
                    word);
 }
 
+/* Charge the space vm has gained since start, less what nested loads
+   have been charged for since loaded, to filename's entry in
+   vm->loads.  If there's no room for a new entry, only the totals
+   get charged. */
+static void
+charge_load (ts_VM *vm, const char *filename, 
+             const ts_Marker *start, const ts_Load_stats *loaded)
+{
+  ts_Load_stats *total = &vm->loaded;
+  int words = (vm->where - start->where) - (total->words - loaded->words);
+  int code = (vm->here - start->here) - (total->code_bytes - loaded->code_bytes);
+  int strings = (start->there - vm->there) 
+              - (total->string_bytes - loaded->string_bytes);
+  int i;
+  total->words += words;
+  total->code_bytes += code;
+  total->string_bytes += strings;
+  ++(total->loads);
+  for (i = 0; i < vm->nloads; ++i)
+    if (0 == strncmp (vm->loads[i].filename, filename, 
+                      sizeof vm->loads[i].filename - 1))
+      break;
+  if (i == vm->nloads)
+    {
+      if (ts_max_load_stats == vm->nloads)
+        return;
+      ++(vm->nloads);
+      memset (vm->loads + i, 0, sizeof vm->loads[i]);
+      strncpy (vm->loads[i].filename, filename, 
+               sizeof vm->loads[i].filename - 1);
+    }
+  vm->loads[i].loads++;
+  vm->loads[i].words += words;
+  vm->loads[i].code_bytes += code;
+  vm->loads[i].string_bytes += strings;
+}
+
 /* Read and execute source code from the file named `filename',
    starting and ending in interpret mode. */
 void
@@ -1527,6 +2420,11 @@ ts_load (ts_VM *vm, const char *filename)
     ts_error (vm, "%s: %s\n", filename, strerror (errno));
   else
     {
+      ts_Marker start;
+      ts_Load_stats loaded = vm->loaded;
+      char in_command = vm->in_command;
+      ts_mark (vm, &start);
+      vm->in_command = no;
       ts_TRY (vm, frame)
         {
           ts_set_input_file_stream (vm, fp, filename);
@@ -1537,24 +2435,41 @@ ts_load (ts_VM *vm, const char *filename)
           fclose (fp);
           vm->mode = '(';       /* should probably move this into callee */
           vm->input = saved;
+          vm->in_command = in_command;
           ts_POP_TRY (vm, frame);
+          charge_load (vm, filename, &start, &loaded);
         }
       ts_EXCEPT (vm, frame)
         {
           fclose (fp);
           vm->mode = '(';
           vm->input = saved;
+          vm->in_command = in_command;
+          charge_load (vm, filename, &start, &loaded);
           ts_escape (vm, frame.complaint);
         }
     }
 }
 
-/* Read and execute the contents of string. */
+/* Read and execute the contents of string.  Its scratch strings get
+   reclaimed even if it fails, as in the interactive loop. */
 void
 ts_load_string (ts_VM *vm, const char *string)
 {
-  ts_set_input_string (vm, string);
-  ts_loading_loop (vm);
+  Command_mark mark;
+  begin_command (vm, &mark);
+  ts_TRY (vm, frame)
+    {
+      ts_set_input_string (vm, string);
+      ts_loading_loop (vm);
+      ts_POP_TRY (vm, frame);
+      end_command (vm, &mark);
+    }
+  ts_EXCEPT (vm, frame)
+    {
+      end_command (vm, &mark);
+      ts_escape (vm, frame.complaint);
+    }
 }
 
 /* Do an interactive loop with stream as the input. */
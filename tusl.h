@@ -6,17 +6,19 @@
 #define TUSL_H
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <setjmp.h>
 
 /* Edit here to configure -------------------------------------------- */
-#if 0
-/* For 32-bit systems */
+#ifdef TS_CELL32
+/* 32-bit cells, on any host: define TS_CELL32 when compiling both the
+   library and everything that includes this header. */
 typedef int tsint;              /* TODO call it ts_Cell or something? */
 typedef unsigned int tsuint;
 typedef float tsfloat;
 #else
-/* For 64-bitters */
+/* 64-bit cells */
 typedef long long int tsint;
 typedef unsigned long long int tsuint;
 typedef double tsfloat;
@@ -25,9 +27,27 @@ enum { ts_stack_size = 1024 };  /* Max. depth of the data stack */
 enum { ts_data_size = 65536 };  /* Max. # of bytes in the data area */
                                 /*  (must be a multiple of sizeof(tsint) */
 enum { ts_dictionary_size = 2048 }; /* Max. # of dictionary entries */
-/* TODO static assert: tsuint, tsfloat, pointer types all same size as tsint */
 /* ------------------------------------------------------------------- */
 
+/* Compiled code is a sequence of these units: dictionary indices,
+   each followed by any inline operands it takes.  Define
+   TS_COMPACT_CODE for 16-bit units instead of whole cells. */
+#ifdef TS_COMPACT_CODE
+typedef unsigned short ts_Code;
+#else
+typedef tsint ts_Code;
+#endif
+
+/* A word's datum is wide enough for either a cell or a host pointer,
+   since cells needn't be. */
+typedef intptr_t ts_Datum;
+
+/* Floats travel as their bit patterns in cells. */
+typedef char ts_check_cell_sizes[sizeof (tsint) == sizeof (tsuint)
+                                 && sizeof (tsint) == sizeof (tsfloat)
+                                 && sizeof (tsint) <= sizeof (ts_Datum)
+                                 ? 1 : -1];
+
 /* The `inline' keyword varies across compilers. */
 #if defined(__GNUC__)
 # define INLINE __inline__
@@ -41,6 +61,11 @@ enum { ts_dictionary_size = 2048 }; /* Max. # of dictionary entries */
 
 /* Forward declarations */
 typedef struct ts_Handler_frame ts_Handler_frame;
+typedef struct ts_Pool ts_Pool;
+typedef struct ts_Tasks ts_Tasks;
+typedef struct ts_Channel ts_Channel;
+typedef struct ts_Profile ts_Profile;
+typedef struct ts_Trace ts_Trace;
 typedef struct ts_Stream ts_Stream;
 typedef struct ts_Word ts_Word;
 typedef struct ts_VM ts_VM;
@@ -49,6 +74,7 @@ typedef int ts_Streamer (ts_VM *);
 typedef int ts_TraceFn (ts_VM *vm, unsigned word);
 typedef int ts_CTraceFn (ts_VM *vm, ts_Word *);
 typedef const char *ts_ErrorFn (ts_VM *vm, const char *format, va_list args);
+typedef void ts_DieFn (void *data);
 
 /* Chain of exception handlers */
 struct ts_Handler_frame {
@@ -95,15 +121,27 @@ struct ts_Stream {
 /* A dictionary entry */
 struct ts_Word {
   ts_Action *action;            /* How to execute this word */
-  tsint datum;                  /* Private argument for action */
+  ts_Datum datum;               /* Private argument for action */
   char *name;                   /* This word's name */
 };
 
+/* Space taken by the source loaded from one file */
+typedef struct ts_Load_stats {
+  char filename[64];            /* (possibly truncated) */
+  int loads;                    /* # of times it was loaded */
+  int words;                    /* Dictionary entries added */
+  int code_bytes;               /* Bytes added at here */
+  int string_bytes;             /* Bytes added at there */
+} ts_Load_stats;
+enum { ts_max_load_stats = 16 }; /* # of files we keep track of */
+
+enum { ts_heap_classes = 12 };  /* Heap block sizes: 32, 64, ... 64K */
+
 /* A TUSL virtual machine */
 struct ts_VM {
   tsint stack[ts_stack_size];   /* The data stack; grows upwards */
   int sp;                       /* Offset in bytes of the top stack entry */
-  tsint *pc;                    /* Ptr to the next instruction to execute */
+  ts_Code *pc;                  /* Ptr to the next instruction to execute */
   char data[ts_data_size];      /* The data area; holds instructions, etc. */
   int here;                     /* The next free byte within data[] */
   int there;                    /* The first occupied byte of string space */
@@ -113,6 +151,11 @@ struct ts_VM {
   char local_names[256];        /* Space for the names of locals */
   int local_names_ptr;          /* The next free index in local_names[] */
   char mode;                    /* How to interpret the next source token */
+  int scratch;                  /* Start of the scratch pad, if any */
+  int scratch_size;             /* Its size in bytes, or 0 for none */
+  int scratch_used;             /* Bytes in use since the command began */
+  char in_command;              /* Reading a top-level command's own input? */
+  char intern_strings;          /* Share identical compiled literals? */
   ts_Stream output;             /* The current output sink */
   ts_Stream input;              /* The current input source */
   ts_Place token_place;         /* The position of the last token scanned */
@@ -122,25 +165,103 @@ struct ts_VM {
   void *tracer_data;            /* Private data for tracer() */
   ts_CTraceFn *colon_tracer;    /* How to trace a colon definition */
   void *colon_tracer_data;      /* Private data for colon_tracer() */
+  ts_CTraceFn *colon_exit_tracer; /* How to trace leaving one (the result
+                                     is ignored) */
   ts_Handler_frame *handler_stack; /* Currently ready exception handlers */
+  int depth;                    /* # of colon definitions being run */
+  /* High-water marks.  here_peak, there_peak, and where_peak only get
+     brought up to date when space is about to be reclaimed, or when
+     asked for by ts_vm_stats(). */
+  int sp_peak;
+  int here_peak;
+  int there_peak;               /* (the lowest there has been) */
+  int where_peak;
+  int depth_peak;
+  ts_Load_stats loads[ts_max_load_stats]; /* Space taken per file loaded */
+  int nloads;                   /* # of entries in use in loads[] */
+  ts_Load_stats loaded;         /* Totals charged to all of loads[] */
+  int heap_free[ts_heap_classes]; /* Free heap blocks by size class */
+  unsigned char heap_map[ts_data_size / sizeof (tsint)];
+                                /* Per cell of data[]: whether a heap
+                                   block starts there, and its state */
 };
 
+/* How much of a VM's fixed-size areas are in use, and the most that
+   ever has been.  Code and strings share the ts_data_size bytes of
+   the data area. */
+typedef struct ts_VM_stats {
+  int stack_cells, stack_cells_peak;
+  int code_bytes, code_bytes_peak;
+  int string_bytes, string_bytes_peak;
+  int words, words_peak;
+  int call_depth, call_depth_peak;
+  int nloads;
+  const ts_Load_stats *loads;   /* Per loaded file (points into the VM) */
+} ts_VM_stats;
+
+/* How the heap is being used.  Internal fragmentation is in_use -
+   requested; external, free. */
+typedef struct ts_Heap_stats {
+  int blocks[ts_heap_classes];  /* # of blocks by size class */
+  int free_blocks[ts_heap_classes]; /* How many of those are free */
+  int requested;                /* Bytes asked for in blocks in use */
+  int in_use;                   /* Bytes taken by blocks in use */
+  int free;                     /* Bytes in free blocks */
+} ts_Heap_stats;
+
+/* A snapshot of how far a VM's dictionary and data area extend */
+typedef struct ts_Marker {
+  int where;
+  int here;
+  int there;
+} ts_Marker;
+
 ts_VM *ts_vm_make (void);
+ts_VM *ts_vm_clone (ts_VM *original);
 void   ts_vm_unmake (ts_VM *vm);
+void   ts_vm_stats (ts_VM *vm, ts_VM_stats *stats);
 
 void  ts_push (ts_VM *vm, tsint c);
 tsint ts_pop (ts_VM *vm);
 
-void ts_install (ts_VM *vm, char *name, ts_Action *action, tsint datum);
+void ts_install (ts_VM *vm, char *name, ts_Action *action, ts_Datum datum);
 int  ts_lookup (ts_VM *vm, const char *name);
 enum { ts_not_found = -1 };
 
+int  ts_reserve (ts_VM *vm, int size);
+
+int  ts_allocate (ts_VM *vm, int size);
+void ts_free (ts_VM *vm, int addr);
+int  ts_resize (ts_VM *vm, int addr, int size);
+void ts_heap_stats (ts_VM *vm, ts_Heap_stats *stats);
+
+void ts_mark (ts_VM *vm, ts_Marker *marker);
+void ts_forget (ts_VM *vm, const ts_Marker *marker);
+
 void ts_install_standard_words (ts_VM *vm);
 void ts_install_unsafe_words (ts_VM *vm);
 
 void ts_run (ts_VM *vm, tsint word);
+
+/* One call for ts_call_batch() */
+typedef struct ts_Call {
+  int handle;                   /* From ts_word_handle() */
+  const tsint *args;
+  int nargs;
+  tsint *results;
+  int nresults;
+  char complaint[128];          /* Set to "" on success, or else the
+                                   complaint (possibly truncated) */
+} ts_Call;
+
+int ts_word_handle (ts_VM *vm, const char *name);
+const char *ts_call (ts_VM *vm, int handle, const tsint *args, int nargs,
+                     tsint *results, int nresults);
+int ts_call_batch (ts_VM *vm, ts_Call *calls, int ncalls);
 void ts_error (ts_VM *vm, const char *format, ...);
 void ts_die (const char *plaint);
+void ts_on_die (ts_DieFn *fn, void *data);
+void ts_cancel_on_die (ts_DieFn *fn, void *data);
 
 void ts_set_stream (ts_Stream *stream, ts_Streamer *streamer, void *data,
                     const char *opt_filename);
@@ -156,6 +277,7 @@ void ts_loading_loop (ts_VM *vm);
 void ts_load (ts_VM *vm, const char *filename);
 void ts_load_interactive (ts_VM *vm, FILE *stream);
 void ts_load_string (ts_VM *vm, const char *string);
+void ts_set_scratch_pad (ts_VM *vm, int size);
 
 void ts_put_char (ts_VM *vm, char c);
 void ts_put_string (ts_VM *vm, const char *string, int size);
@@ -180,6 +302,83 @@ ts_Action ts_do_push;
 
 ts_Action ts_prim_load;
 
+/* Calling C functions by signature (tuslffi.c) */
+ts_Action ts_run_foreign;
+void ts_install_foreign (ts_VM *vm, char *name, void (*fn)(void),
+                         const char *signature);
+
+/* Array words (tuslarray.c) */
+void ts_install_array_words (ts_VM *vm);
+
+/* Hash tables in data space (tuslhash.c) */
+void ts_install_hash_words (ts_VM *vm);
+
+/* Worker-thread pools (tuslpool.c) */
+ts_Pool *ts_pool_make (ts_VM *original, int nthreads);
+void     ts_pool_unmake (ts_Pool *pool);
+int      ts_pool_size (ts_Pool *pool);
+ts_VM   *ts_pool_vm (ts_Pool *pool, int i);
+int      ts_pool_submit (ts_Pool *pool, int word, tsint arg);
+int      ts_pool_wait (ts_Pool *pool);
+
+enum { ts_par_static = 1 };     /* Flag for ts_par_for() */
+void ts_par_for (ts_VM *vm, int word, int n, int base, int stride,
+                 int nthreads, int flags);
+void ts_install_parallel_words (ts_VM *vm, int nthreads);
+
+enum { ts_chan_multi_producer = 1 }; /* Flag for ts_channel_make() */
+ts_Channel *ts_channel_make (int capacity, int max_bytes, int flags);
+void ts_channel_unmake (ts_Channel *chan);
+int  ts_channel_try_send (ts_Channel *chan, tsint value, 
+                          const char *bytes, int size);
+int  ts_channel_try_recv (ts_Channel *chan, tsint *value, 
+                          char *bytes, int *size);
+void ts_channel_send (ts_Channel *chan, tsint value, 
+                      const char *bytes, int size);
+void ts_channel_recv (ts_Channel *chan, tsint *value, 
+                      char *bytes, int *size);
+void ts_install_channel (ts_VM *vm, char *name, ts_Channel *chan);
+void ts_install_channel_words (ts_VM *vm);
+
+/* Profiling (tuslprof.c) */
+ts_Profile *ts_install_profiler_words (ts_VM *vm);
+void ts_profile_unmake (ts_Profile *prof);
+void ts_profile_start (ts_Profile *prof);
+void ts_profile_stop (ts_Profile *prof);
+void ts_profile_reset (ts_Profile *prof);
+void ts_profile_report (ts_Profile *prof);
+void ts_profile_write_collapsed (ts_Profile *prof);
+
+/* Binary execution traces (tusltrace.c) */
+typedef struct ts_Trace_record {
+  unsigned word;                /* Dictionary index of the word run */
+  int sp;                       /* Stack index of the top, before running */
+  int pc;                       /* Offset of vm->pc in data[], or -1 */
+  int depth;                    /* # of colon definitions being run */
+  long long top;                /* The top of stack (0 if empty) */
+  unsigned long long ns;        /* Monotonic timestamp, if enabled */
+} ts_Trace_record;
+
+enum { ts_trace_timestamps = 1 }; /* Flag for ts_install_trace_words() */
+ts_Trace *ts_install_trace_words (ts_VM *vm, int nrecords, int flags,
+                                  const char *dump_filename);
+void ts_trace_unmake (ts_Trace *trace);
+void ts_trace_start (ts_Trace *trace);
+void ts_trace_stop (ts_Trace *trace);
+int  ts_trace_dump (ts_Trace *trace, const char *filename);
+
+/* Cooperative tasks within a VM (tusltask.c) */
+ts_Tasks *ts_install_task_words (ts_VM *vm, size_t c_stack_size);
+void      ts_tasks_unmake (ts_Tasks *tasks);
+int       ts_spawn (ts_Tasks *tasks, int word);
+void      ts_resume (ts_Tasks *tasks, int task);
+void      ts_yield (ts_Tasks *tasks);
+int       ts_task_done (ts_Tasks *tasks, int task);
+int       ts_current_task (ts_Tasks *tasks);
+void      ts_run_tasks (ts_Tasks *tasks);
+void      ts_set_input_fd (ts_Tasks *tasks, int fd);
+void      ts_set_output_fd (ts_Tasks *tasks, int fd);
+
 /* Return a native pointer to byte i in vm's data space. */
 static INLINE char *
 ts_data_byte (ts_VM *vm, int i)
@@ -189,6 +388,16 @@ ts_data_byte (ts_VM *vm, int i)
   return (char *)(vm->data + i);
 }
 
+/* Return a native pointer to the n bytes starting at byte i in vm's
+   data space, checking that they're all in range. */
+static INLINE char *
+ts_data_range (ts_VM *vm, int i, int n)
+{
+  if (ts_data_size < (unsigned)i || ts_data_size - i < (unsigned)n)
+    ts_error (vm, "Data reference out of range: %d..%d", i, i + n);
+  return (char *)(vm->data + i);
+}
+
 
 /* Stack accesses */
 
@@ -209,9 +418,14 @@ ts__popping (ts_VM *vm, int n)
 static INLINE void
 ts__fix_stack_fn (ts_VM *vm, int delta)
 {
-  if (0 < delta && 
-      ts__spadd (vm, delta) >= ts_stack_size * sizeof vm->stack[0])
-    ts_error (vm, "Stack overflow");
+  if (0 < delta)
+    {
+      int sp = ts__spadd (vm, delta);
+      if (sp >= ts_stack_size * sizeof vm->stack[0])
+        ts_error (vm, "Stack overflow");
+      if (vm->sp_peak < sp)
+        vm->sp_peak = sp;
+    }
   vm->sp = ts__spadd (vm, delta);
 }
 
@@ -0,0 +1,785 @@
+/* TUSL -- the ultimate scripting language.
+   Copyright 2003-2005 Darius Bacon under the terms of the MIT X license
+   found at http://www.opensource.org/licenses/mit-license.html */
+
+/* Words over arrays in data space, each given as an address and a
+   count of cells: array-foo for arrays of tsints, farray-foo for
+   arrays of tsfloats, plus sorting and searching.  The whole range
+   gets bounds-checked once up front; after that the loops are plain
+   C, written so the compiler can vectorize them.  With GCC or Clang
+   on x86-64 each kernel is also compiled for AVX2, picked at load
+   time if the CPU has it.  (The Makefile builds this file at -O3 for
+   the vectorizer.)
+
+   Float reductions keep several partial sums, since the compiler may
+   not reorder float additions itself; so their results can differ
+   in the last bits from a left-to-right sum. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusl.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__APPLE__)
+# define KERNEL __attribute__ ((target_clones ("avx2", "default")))
+#else
+# define KERNEL
+#endif
+
+static INLINE tsfloat i2f (tsint i) { return *(tsfloat*)&i; }
+static INLINE tsint f2i (tsfloat f) { return *(tsint*)&f; }
+
+enum { lanes = 8 };             /* # of partial sums in float reductions */
+
+/* Return a native pointer to the n cells at data index a. */
+static tsint *
+cells_at (ts_VM *vm, tsint a, tsint n)
+{
+  if (n < 0 || (tsint) (ts_data_size / sizeof (tsint)) < n)
+    ts_error (vm, "Bad array length: %ld", (long) n);
+  return (tsint *) ts_data_range (vm, a, n * sizeof (tsint));
+}
+
+static tsfloat *
+floats_at (ts_VM *vm, tsint a, tsint n)
+{
+  return (tsfloat *) cells_at (vm, a, n);
+}
+
+static void
+check_nonempty (ts_VM *vm, tsint n)
+{
+  if (n <= 0)
+    ts_error (vm, "Empty array");
+}
+
+
+/* Kernels */
+
+static KERNEL tsint
+sum_cells (const tsint *a, long n)
+{
+  tsint sum = 0;
+  long i;
+  for (i = 0; i < n; ++i)
+    sum += a[i];
+  return sum;
+}
+
+static KERNEL tsint
+min_cells (const tsint *a, long n)
+{
+  tsint m = a[0];
+  long i;
+  for (i = 1; i < n; ++i)
+    m = a[i] < m ? a[i] : m;
+  return m;
+}
+
+static KERNEL tsint
+max_cells (const tsint *a, long n)
+{
+  tsint m = a[0];
+  long i;
+  for (i = 1; i < n; ++i)
+    m = m < a[i] ? a[i] : m;
+  return m;
+}
+
+static KERNEL tsint
+dot_cells (const tsint *a, const tsint *b, long n)
+{
+  tsint sum = 0;
+  long i;
+  for (i = 0; i < n; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+static KERNEL void
+axpy_cells (tsint k, const tsint *a, tsint *b, long n)
+{
+  long i;
+  for (i = 0; i < n; ++i)
+    b[i] += k * a[i];
+}
+
+static KERNEL void
+add_cells (const tsint *a, const tsint *b, tsint *dest, long n)
+{
+  long i;
+  for (i = 0; i < n; ++i)
+    dest[i] = a[i] + b[i];
+}
+
+static KERNEL void
+mul_cells (const tsint *a, const tsint *b, tsint *dest, long n)
+{
+  long i;
+  for (i = 0; i < n; ++i)
+    dest[i] = a[i] * b[i];
+}
+
+static void
+prefix_sum_cells (tsint *a, long n)
+{
+  long i;
+  for (i = 1; i < n; ++i)
+    a[i] += a[i - 1];
+}
+
+static KERNEL tsint
+count_less_cells (const tsint *a, long n, tsint x)
+{
+  tsint count = 0;
+  long i;
+  for (i = 0; i < n; ++i)
+    count += a[i] < x;
+  return count;
+}
+
+static KERNEL tsfloat
+sum_floats (const tsfloat *a, long n)
+{
+  tsfloat part[lanes] = { 0 }, sum = 0;
+  long i, j;
+  for (i = 0; i + lanes <= n; i += lanes)
+    for (j = 0; j < lanes; ++j)
+      part[j] += a[i + j];
+  for (; i < n; ++i)
+    sum += a[i];
+  for (j = 0; j < lanes; ++j)
+    sum += part[j];
+  return sum;
+}
+
+static KERNEL tsfloat
+min_floats (const tsfloat *a, long n)
+{
+  tsfloat m = a[0];
+  long i;
+  for (i = 1; i < n; ++i)
+    m = a[i] < m ? a[i] : m;
+  return m;
+}
+
+static KERNEL tsfloat
+max_floats (const tsfloat *a, long n)
+{
+  tsfloat m = a[0];
+  long i;
+  for (i = 1; i < n; ++i)
+    m = m < a[i] ? a[i] : m;
+  return m;
+}
+
+static KERNEL tsfloat
+dot_floats (const tsfloat *a, const tsfloat *b, long n)
+{
+  tsfloat part[lanes] = { 0 }, sum = 0;
+  long i, j;
+  for (i = 0; i + lanes <= n; i += lanes)
+    for (j = 0; j < lanes; ++j)
+      part[j] += a[i + j] * b[i + j];
+  for (; i < n; ++i)
+    sum += a[i] * b[i];
+  for (j = 0; j < lanes; ++j)
+    sum += part[j];
+  return sum;
+}
+
+static KERNEL void
+axpy_floats (tsfloat k, const tsfloat *a, tsfloat *b, long n)
+{
+  long i;
+  for (i = 0; i < n; ++i)
+    b[i] += k * a[i];
+}
+
+static KERNEL void
+add_floats (const tsfloat *a, const tsfloat *b, tsfloat *dest, long n)
+{
+  long i;
+  for (i = 0; i < n; ++i)
+    dest[i] = a[i] + b[i];
+}
+
+static KERNEL void
+mul_floats (const tsfloat *a, const tsfloat *b, tsfloat *dest, long n)
+{
+  long i;
+  for (i = 0; i < n; ++i)
+    dest[i] = a[i] * b[i];
+}
+
+static void
+prefix_sum_floats (tsfloat *a, long n)
+{
+  long i;
+  for (i = 1; i < n; ++i)
+    a[i] += a[i - 1];
+}
+
+static KERNEL tsint
+count_less_floats (const tsfloat *a, long n, tsfloat x)
+{
+  tsint count = 0;
+  long i;
+  for (i = 0; i < n; ++i)
+    count += a[i] < x;
+  return count;
+}
+
+
+/* Words.  In the stack comments a and b are source arrays, dest a
+   destination, and n the count of cells in each. */
+
+/* ( a n -- sum ) */
+static void
+array_sum (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  ts_OUTPUT_1 (sum_cells (cells_at (vm, a, n), n));
+}
+
+/* ( a n -- min ) */
+static void
+array_min (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  tsint *p = cells_at (vm, a, n);
+  check_nonempty (vm, n);
+  ts_OUTPUT_1 (min_cells (p, n));
+}
+
+/* ( a n -- max ) */
+static void
+array_max (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  tsint *p = cells_at (vm, a, n);
+  check_nonempty (vm, n);
+  ts_OUTPUT_1 (max_cells (p, n));
+}
+
+/* ( a b n -- a.b ) */
+static void
+array_dot (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, a, b, n);
+  ts_OUTPUT_1 (dot_cells (cells_at (vm, a, n), cells_at (vm, b, n), n));
+}
+
+/* ( k a b n -- ) b += k*a */
+static void
+array_axpy (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_4 (vm, k, a, b, n);
+  ts_OUTPUT_0 ();
+  axpy_cells (k, cells_at (vm, a, n), cells_at (vm, b, n), n);
+}
+
+/* ( a b dest n -- ) dest = a+b */
+static void
+array_add (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_4 (vm, a, b, dest, n);
+  ts_OUTPUT_0 ();
+  add_cells (cells_at (vm, a, n), cells_at (vm, b, n),
+             cells_at (vm, dest, n), n);
+}
+
+/* ( a b dest n -- ) dest = a*b, elementwise */
+static void
+array_mul (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_4 (vm, a, b, dest, n);
+  ts_OUTPUT_0 ();
+  mul_cells (cells_at (vm, a, n), cells_at (vm, b, n),
+             cells_at (vm, dest, n), n);
+}
+
+/* ( a n -- ) Replace each element by the sum up to and including it. */
+static void
+array_prefix_sum (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  ts_OUTPUT_0 ();
+  prefix_sum_cells (cells_at (vm, a, n), n);
+}
+
+/* ( a n x -- count ) The number of elements less than x. */
+static void
+array_count_less (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, a, n, x);
+  ts_OUTPUT_1 (count_less_cells (cells_at (vm, a, n), n, x));
+}
+
+static void
+farray_sum (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  ts_OUTPUT_1 (f2i (sum_floats (floats_at (vm, a, n), n)));
+}
+
+static void
+farray_min (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  tsfloat *p = floats_at (vm, a, n);
+  check_nonempty (vm, n);
+  ts_OUTPUT_1 (f2i (min_floats (p, n)));
+}
+
+static void
+farray_max (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  tsfloat *p = floats_at (vm, a, n);
+  check_nonempty (vm, n);
+  ts_OUTPUT_1 (f2i (max_floats (p, n)));
+}
+
+static void
+farray_dot (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, a, b, n);
+  ts_OUTPUT_1 (f2i (dot_floats (floats_at (vm, a, n),
+                                floats_at (vm, b, n), n)));
+}
+
+static void
+farray_axpy (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_4 (vm, k, a, b, n);
+  ts_OUTPUT_0 ();
+  axpy_floats (i2f (k), floats_at (vm, a, n), floats_at (vm, b, n), n);
+}
+
+static void
+farray_add (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_4 (vm, a, b, dest, n);
+  ts_OUTPUT_0 ();
+  add_floats (floats_at (vm, a, n), floats_at (vm, b, n),
+              floats_at (vm, dest, n), n);
+}
+
+static void
+farray_mul (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_4 (vm, a, b, dest, n);
+  ts_OUTPUT_0 ();
+  mul_floats (floats_at (vm, a, n), floats_at (vm, b, n),
+              floats_at (vm, dest, n), n);
+}
+
+static void
+farray_prefix_sum (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  ts_OUTPUT_0 ();
+  prefix_sum_floats (floats_at (vm, a, n), n);
+}
+
+static void
+farray_count_less (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, a, n, x);
+  ts_OUTPUT_1 (count_less_floats (floats_at (vm, a, n), n, i2f (x)));
+}
+
+/* Sorting and searching.  Plain ascending sorts of cells (signed or
+   unsigned) and floats are radix sorts on the bits; the -by variants
+   take a word ( x y -- flag ) that says whether x goes before y, run
+   through ts_call(), and use introsort.  If the word raises an
+   exception, the array is left partly sorted. */
+
+typedef int Less (void *context, tsint x, tsint y);
+
+static int
+less_signed (void *context, tsint x, tsint y)
+{
+  return x < y;
+}
+
+static int
+less_unsigned (void *context, tsint x, tsint y)
+{
+  return (tsuint) x < (tsuint) y;
+}
+
+/* The context of a -by word's comparisons */
+typedef struct By {
+  ts_VM *vm;
+  int word;
+} By;
+
+static int
+less_by_word (void *context, tsint x, tsint y)
+{
+  By *by = context;
+  tsint args[2], flag;
+  const char *complaint;
+  args[0] = x, args[1] = y;
+  complaint = ts_call (by->vm, by->word, args, 2, &flag, 1);
+  if (NULL != complaint)
+    ts_escape (by->vm, complaint);
+  return 0 != flag;
+}
+
+static void
+swap (tsint *a, long i, long j)
+{
+  tsint t = a[i];
+  a[i] = a[j];
+  a[j] = t;
+}
+
+static void
+insertion_sort (tsint *a, long n, Less *less, void *context)
+{
+  long i, j;
+  for (i = 1; i < n; ++i)
+    {
+      tsint x = a[i];
+      for (j = i; 0 < j && less (context, x, a[j - 1]); --j)
+        a[j] = a[j - 1];
+      a[j] = x;
+    }
+}
+
+static void
+sift_down (tsint *a, long root, long n, Less *less, void *context)
+{
+  for (;;)
+    {
+      long child = 2 * root + 1;
+      if (n <= child)
+        break;
+      if (child + 1 < n && less (context, a[child], a[child + 1]))
+        ++child;
+      if (!less (context, a[root], a[child]))
+        break;
+      swap (a, root, child);
+      root = child;
+    }
+}
+
+static void
+heap_sort (tsint *a, long n, Less *less, void *context)
+{
+  long i;
+  for (i = n / 2 - 1; 0 <= i; --i)
+    sift_down (a, i, n, less, context);
+  for (i = n - 1; 0 < i; --i)
+    {
+      swap (a, 0, i);
+      sift_down (a, 0, i, less, context);
+    }
+}
+
+/* Partition a around the median of its first, middle and last
+   elements, returning p such that a[0..p) <= pivot <= a[p..n), with
+   0 < p < n.  The scans stop at the ends of a even if less isn't a
+   consistent ordering, as a script's comparison word might not be;
+   then the order comes out wrong, but we stay in bounds and make
+   progress. */
+static long
+partition (tsint *a, long n, Less *less, void *context)
+{
+  long mid = n / 2, i = 0, j = n - 1;
+  tsint pivot;
+  if (less (context, a[mid], a[0]))
+    swap (a, mid, 0);
+  if (less (context, a[n - 1], a[mid]))
+    {
+      swap (a, n - 1, mid);
+      if (less (context, a[mid], a[0]))
+        swap (a, mid, 0);
+    }
+  pivot = a[mid];
+  for (;;)
+    {
+      while (i < n - 1 && less (context, a[i], pivot))
+        ++i;
+      while (0 < j && less (context, pivot, a[j]))
+        --j;
+      if (j <= i)
+        return j + 1 < n ? j + 1 : n - 1;
+      swap (a, i++, j--);
+    }
+}
+
+enum { small_sort = 24 };       /* Sizes we just insertion-sort */
+
+static void
+introsort (tsint *a, long n, int depth, Less *less, void *context)
+{
+  while (small_sort < n)
+    {
+      long p;
+      if (0 == depth--)
+        {
+          heap_sort (a, n, less, context);
+          return;
+        }
+      p = partition (a, n, less, context);
+      /* Recur on the smaller side to bound the C stack. */
+      if (p < n - p)
+        {
+          introsort (a, p, depth, less, context);
+          a += p, n -= p;
+        }
+      else
+        {
+          introsort (a + p, n - p, depth, less, context);
+          n = p;
+        }
+    }
+  insertion_sort (a, n, less, context);
+}
+
+static void
+sort (tsint *a, long n, Less *less, void *context)
+{
+  int depth = 0;
+  long m;
+  for (m = n; 1 < m; m >>= 1)
+    depth += 2;
+  introsort (a, n, depth, less, context);
+}
+
+/* Rearrange a so a[k] is what it would be if sorted, with nothing
+   after it going before it and nothing before it going after. */
+static void
+select_nth (tsint *a, long n, long k, Less *less, void *context)
+{
+  while (small_sort < n)
+    {
+      long p = partition (a, n, less, context);
+      if (k < p)
+        n = p;
+      else
+        a += p, n -= p, k -= p;
+    }
+  insertion_sort (a, n, less, context);
+}
+
+/* Return the first index in sorted a whose element doesn't go before
+   x. */
+static long
+lower_bound (const tsint *a, long n, tsint x, Less *less, void *context)
+{
+  long lo = 0, hi = n;
+  while (lo < hi)
+    {
+      long mid = lo + (hi - lo) / 2;
+      if (less (context, a[mid], x))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Sort n cells as unsigned numbers, least significant byte first,
+   skipping the bytes that are the same all through. */
+static void
+radix_sort (ts_VM *vm, tsuint *a, long n)
+{
+  enum { digits = sizeof (tsuint) };
+  long (*counts)[256];
+  tsuint *from = a, *to;
+  long i;
+  int d;
+  if (n <= small_sort)
+    {
+      insertion_sort ((tsint *) a, n, less_unsigned, NULL);
+      return;
+    }
+  to = malloc (n * sizeof to[0]);
+  counts = calloc (digits, sizeof counts[0]);
+  if (NULL == to || NULL == counts)
+    {
+      free (to);
+      free (counts);
+      ts_error (vm, "Out of memory for sorting");
+    }
+  for (i = 0; i < n; ++i)
+    for (d = 0; d < digits; ++d)
+      ++counts[d][(a[i] >> (8 * d)) & 255];
+  for (d = 0; d < digits; ++d)
+    {
+      long *count = counts[d], sum = 0;
+      int b;
+      if (n == count[(a[0] >> (8 * d)) & 255])
+        continue;
+      for (b = 0; b < 256; ++b)
+        {
+          long c = count[b];
+          count[b] = sum;
+          sum += c;
+        }
+      for (i = 0; i < n; ++i)
+        to[count[(from[i] >> (8 * d)) & 255]++] = from[i];
+      {
+        tsuint *t = from;
+        from = to, to = t;
+      }
+    }
+  if (from != a)
+    {
+      memcpy (a, from, n * sizeof a[0]);
+      to = from;
+    }
+  free (to);
+  free (counts);
+}
+
+static const tsuint sign_bit = (tsuint) 1 << (8 * sizeof (tsuint) - 1);
+
+/* ( a n -- ) */
+static void
+sort_cells (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  tsuint *p = (tsuint *) cells_at (vm, a, n);
+  long i;
+  ts_OUTPUT_0 ();
+  for (i = 0; i < n; ++i)
+    p[i] ^= sign_bit;
+  radix_sort (vm, p, n);
+  for (i = 0; i < n; ++i)
+    p[i] ^= sign_bit;
+}
+
+/* ( a n -- ) */
+static void
+usort_cells (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  ts_OUTPUT_0 ();
+  radix_sort (vm, (tsuint *) cells_at (vm, a, n), n);
+}
+
+/* ( a n -- ) Negative floats have their bits all flipped and positive
+   ones just their sign, which makes them sort as unsigned numbers. */
+static void
+fsort (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, a, n);
+  tsuint *p = (tsuint *) cells_at (vm, a, n);
+  long i;
+  ts_OUTPUT_0 ();
+  for (i = 0; i < n; ++i)
+    p[i] = (p[i] & sign_bit) ? ~p[i] : p[i] | sign_bit;
+  radix_sort (vm, p, n);
+  for (i = 0; i < n; ++i)
+    p[i] = (p[i] & sign_bit) ? p[i] & ~sign_bit : ~p[i];
+}
+
+/* ( a n word -- ) */
+static void
+sort_cells_by (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, a, n, word);
+  tsint *p = cells_at (vm, a, n);
+  By by;
+  ts_OUTPUT_0 ();
+  by.vm = vm, by.word = word;
+  sort (p, n, less_by_word, &by);
+}
+
+/* ( a n x -- i flag ) Find where x goes in sorted a: i is the first
+   index whose element is not less than x, and flag says whether it's
+   equal. */
+static void
+bsearch_cells (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, a, n, x);
+  tsint *p = cells_at (vm, a, n);
+  long i = lower_bound (p, n, x, less_signed, NULL);
+  ts_OUTPUT_2 (i, -(i < n && p[i] == x));
+}
+
+/* ( a n x word -- i flag ) As above, but with a sorted by word. */
+static void
+bsearch_cells_by (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_4 (vm, a, n, x, word);
+  tsint *p = cells_at (vm, a, n);
+  By by;
+  long i;
+  int found;
+  by.vm = vm, by.word = word;
+  i = lower_bound (p, n, x, less_by_word, &by);
+  found = i < n && !less_by_word (&by, x, p[i]);
+  ts_OUTPUT_2 (i, -found);
+}
+
+static void
+check_index (ts_VM *vm, tsint k, tsint n)
+{
+  if (k < 0 || n <= k)
+    ts_error (vm, "Index out of range: %ld", (long) k);
+}
+
+/* ( a n k -- ) */
+static void
+nth_element (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, a, n, k);
+  tsint *p = cells_at (vm, a, n);
+  ts_OUTPUT_0 ();
+  check_index (vm, k, n);
+  select_nth (p, n, k, less_signed, NULL);
+}
+
+/* ( a n k word -- ) */
+static void
+nth_element_by (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_4 (vm, a, n, k, word);
+  tsint *p = cells_at (vm, a, n);
+  By by;
+  ts_OUTPUT_0 ();
+  check_index (vm, k, n);
+  by.vm = vm, by.word = word;
+  select_nth (p, n, k, less_by_word, &by);
+}
+
+/* Add the array words to vm's dictionary. */
+void
+ts_install_array_words (ts_VM *vm)
+{
+  ts_install (vm, "array-sum",         array_sum, 0);
+  ts_install (vm, "array-min",         array_min, 0);
+  ts_install (vm, "array-max",         array_max, 0);
+  ts_install (vm, "array-dot",         array_dot, 0);
+  ts_install (vm, "array-axpy",        array_axpy, 0);
+  ts_install (vm, "array-add",         array_add, 0);
+  ts_install (vm, "array-mul",         array_mul, 0);
+  ts_install (vm, "array-prefix-sum",  array_prefix_sum, 0);
+  ts_install (vm, "array-count<",      array_count_less, 0);
+
+  ts_install (vm, "farray-sum",        farray_sum, 0);
+  ts_install (vm, "farray-min",        farray_min, 0);
+  ts_install (vm, "farray-max",        farray_max, 0);
+  ts_install (vm, "farray-dot",        farray_dot, 0);
+  ts_install (vm, "farray-axpy",       farray_axpy, 0);
+  ts_install (vm, "farray-add",        farray_add, 0);
+  ts_install (vm, "farray-mul",        farray_mul, 0);
+  ts_install (vm, "farray-prefix-sum", farray_prefix_sum, 0);
+  ts_install (vm, "farray-count<",     farray_count_less, 0);
+
+  ts_install (vm, "sort-cells",        sort_cells, 0);
+  ts_install (vm, "usort-cells",       usort_cells, 0);
+  ts_install (vm, "fsort",             fsort, 0);
+  ts_install (vm, "sort-cells-by",     sort_cells_by, 0);
+  ts_install (vm, "bsearch-cells",     bsearch_cells, 0);
+  ts_install (vm, "bsearch-cells-by",  bsearch_cells_by, 0);
+  ts_install (vm, "nth-element",       nth_element, 0);
+  ts_install (vm, "nth-element-by",    nth_element_by, 0);
+}
@@ -0,0 +1,231 @@
+/* TUSL -- the ultimate scripting language.
+   Copyright 2003-2005 Darius Bacon under the terms of the MIT X license
+   found at http://www.opensource.org/licenses/mit-license.html */
+
+/* Calling C functions described by a signature string, like "dd:d"
+   for double f(double, double).  Before the colon, one letter per
+   argument: i for a tsint, d for a tsfloat (passed as a C double), p
+   for a data-space address, passed as a native pointer.  After it,
+   the result: i, d, or v for none.  As with ts_run_int_n, the
+   arguments are popped with the topmost as the rightmost, and floats
+   travel as their bit patterns in cells.
+
+   C can't make up a call to an arbitrary function type at runtime, so
+   there is a call stub compiled in for each signature we support:
+   every mix of i, d and p up to 3 arguments, every mix of i and d for
+   4, and all-i, all-d or all-p up to 12.  Each stub calls through the
+   exact function type, so an i is a tsint and a p a void *, whatever
+   the cell width.  (Arguments wait in pointer-sized integers, so a p
+   fits even when cells are narrower.)  Installing a function looks up
+   its stub once; calling it is then just one copy of its arguments off
+   the stack and one indirect call. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tusl.h"
+
+static INLINE tsfloat i2f (tsint i) { return *(tsfloat*)&i; }
+static INLINE tsint f2i (tsfloat f) { return *(tsint*)&f; }
+
+typedef void Fn (void);
+typedef void Stub (Fn *f, const ts_Datum *a, tsint *result);
+
+enum { max_args = 12 };
+
+/* The types, argument fetchers and result storers for each letter */
+#define T_i tsint
+#define T_d double
+#define T_p void *
+#define T_v void
+#define A_i(k) ((tsint) a[k])
+#define A_d(k) i2f ((tsint) a[k])
+#define A_p(k) ((void *) a[k])
+#define R_i(call) (*result = (call))
+#define R_d(call) (*result = f2i ((tsfloat) (call)))
+#define R_v(call) (call)
+
+#define STUB(r, sig, params, args) \
+  static void stub_##r##_##sig (Fn *f, const ts_Datum *a, tsint *result) \
+    { R_##r (((T_##r (*) params) f) args); }
+
+#define STUB0(r) \
+  STUB (r, , (void), ())
+#define STUB1(r, t0) \
+  STUB (r, t0, (T_##t0), (A_##t0 (0)))
+#define STUB2(r, t0, t1) \
+  STUB (r, t0##t1, (T_##t0, T_##t1), (A_##t0 (0), A_##t1 (1)))
+#define STUB3(r, t0, t1, t2) \
+  STUB (r, t0##t1##t2, (T_##t0, T_##t1, T_##t2), \
+        (A_##t0 (0), A_##t1 (1), A_##t2 (2)))
+#define STUB4(r, t0, t1, t2, t3) \
+  STUB (r, t0##t1##t2##t3, (T_##t0, T_##t1, T_##t2, T_##t3), \
+        (A_##t0 (0), A_##t1 (1), A_##t2 (2), A_##t3 (3)))
+
+/* All-one-type stubs for 5 to 12 arguments */
+#define P5(t) T_##t, T_##t, T_##t, T_##t, T_##t
+#define P6(t) P5 (t), T_##t
+#define P7(t) P6 (t), T_##t
+#define P8(t) P7 (t), T_##t
+#define P9(t) P8 (t), T_##t
+#define P10(t) P9 (t), T_##t
+#define P11(t) P10 (t), T_##t
+#define P12(t) P11 (t), T_##t
+#define V5(t) A_##t (0), A_##t (1), A_##t (2), A_##t (3), A_##t (4)
+#define V6(t) V5 (t), A_##t (5)
+#define V7(t) V6 (t), A_##t (6)
+#define V8(t) V7 (t), A_##t (7)
+#define V9(t) V8 (t), A_##t (8)
+#define V10(t) V9 (t), A_##t (9)
+#define V11(t) V10 (t), A_##t (10)
+#define V12(t) V11 (t), A_##t (11)
+#define STUBN(r, t, n) STUB (r, t##n, (P##n (t)), (V##n (t)))
+
+/* Apply X to every argument signature, for result type r. */
+#define EACH_SIGNATURE(X, r) \
+  X##0 (r) \
+  X##1 (r, i) X##1 (r, d) X##1 (r, p) \
+  X##2 (r, i, i) X##2 (r, i, d) X##2 (r, i, p) X##2 (r, d, i) \
+  X##2 (r, d, d) X##2 (r, d, p) X##2 (r, p, i) X##2 (r, p, d) \
+  X##2 (r, p, p) \
+  X##3 (r, i, i, i) X##3 (r, i, i, d) X##3 (r, i, i, p) X##3 (r, i, d, i) \
+  X##3 (r, i, d, d) X##3 (r, i, d, p) X##3 (r, i, p, i) X##3 (r, i, p, d) \
+  X##3 (r, i, p, p) X##3 (r, d, i, i) X##3 (r, d, i, d) X##3 (r, d, i, p) \
+  X##3 (r, d, d, i) X##3 (r, d, d, d) X##3 (r, d, d, p) X##3 (r, d, p, i) \
+  X##3 (r, d, p, d) X##3 (r, d, p, p) X##3 (r, p, i, i) X##3 (r, p, i, d) \
+  X##3 (r, p, i, p) X##3 (r, p, d, i) X##3 (r, p, d, d) X##3 (r, p, d, p) \
+  X##3 (r, p, p, i) X##3 (r, p, p, d) X##3 (r, p, p, p) \
+  X##4 (r, i, i, i, i) X##4 (r, i, i, i, d) X##4 (r, i, i, d, i) \
+  X##4 (r, i, i, d, d) X##4 (r, i, d, i, i) X##4 (r, i, d, i, d) \
+  X##4 (r, i, d, d, i) X##4 (r, i, d, d, d) X##4 (r, d, i, i, i) \
+  X##4 (r, d, i, i, d) X##4 (r, d, i, d, i) X##4 (r, d, i, d, d) \
+  X##4 (r, d, d, i, i) X##4 (r, d, d, i, d) X##4 (r, d, d, d, i) \
+  X##4 (r, d, d, d, d) X##4 (r, p, p, p, p) \
+  X##N (r, i, 5) X##N (r, i, 6) X##N (r, i, 7) X##N (r, i, 8) \
+  X##N (r, i, 9) X##N (r, i, 10) X##N (r, i, 11) X##N (r, i, 12) \
+  X##N (r, d, 5) X##N (r, d, 6) X##N (r, d, 7) X##N (r, d, 8) \
+  X##N (r, d, 9) X##N (r, d, 10) X##N (r, d, 11) X##N (r, d, 12) \
+  X##N (r, p, 5) X##N (r, p, 6) X##N (r, p, 7) X##N (r, p, 8) \
+  X##N (r, p, 9) X##N (r, p, 10) X##N (r, p, 11) X##N (r, p, 12)
+
+EACH_SIGNATURE (STUB, i)
+EACH_SIGNATURE (STUB, d)
+EACH_SIGNATURE (STUB, v)
+
+/* The table of stubs by signature.  The all-one-type ones are listed
+   under a count instead of spelled out, e.g. "i12:d". */
+typedef struct Entry {
+  const char *signature;
+  Stub *stub;
+} Entry;
+
+#define ENTRY(r, sig, str) { str ":" #r, stub_##r##_##sig },
+#define ENTRY0(r)                { ":" #r, stub_##r##_ },
+#define ENTRY1(r, t0)            ENTRY (r, t0, #t0)
+#define ENTRY2(r, t0, t1)        ENTRY (r, t0##t1, #t0 #t1)
+#define ENTRY3(r, t0, t1, t2)    ENTRY (r, t0##t1##t2, #t0 #t1 #t2)
+#define ENTRY4(r, t0, t1, t2, t3) \
+  ENTRY (r, t0##t1##t2##t3, #t0 #t1 #t2 #t3)
+#define ENTRYN(r, t, n)          ENTRY (r, t##n, #t #n)
+
+static const Entry entries[] = {
+  EACH_SIGNATURE (ENTRY, i)
+  EACH_SIGNATURE (ENTRY, d)
+  EACH_SIGNATURE (ENTRY, v)
+};
+
+/* A foreign word's datum points to this, malloc'd and out of the
+   script's reach.  It lives as long as the process, like the C
+   function it describes. */
+typedef struct Descriptor {
+  Fn *fn;                       /* The C function, cast */
+  Stub *stub;                   /* How to call it */
+  int nargs;
+  int pointers;                 /* Bit k set if argument k is a p */
+  int returns;                  /* Whether there's a result to push */
+} Descriptor;
+
+/* Return the entries[] index for signature, or -1 if there's no stub
+   for it. */
+static int
+find_stub (const char *signature)
+{
+  char key[max_args + 4], first[2] = { signature[0], '\0' };
+  const char *colon = strchr (signature, ':');
+  int nargs = colon - signature, i;
+  if (max_args < nargs)
+    return -1;
+  /* Spell all-one-type signatures past 4 arguments as a count. */
+  if (4 < nargs && strspn (signature, first) == (size_t) nargs)
+    sprintf (key, "%c%d%s", signature[0], nargs, colon);
+  else
+    strcpy (key, signature);
+  for (i = 0; i < (int) (sizeof entries / sizeof entries[0]); ++i)
+    if (0 == strcmp (key, entries[i].signature))
+      return i;
+  return -1;
+}
+
+/* The action of a foreign word. */
+void
+ts_run_foreign (ts_VM *vm, ts_Word *pw)
+{
+  const Descriptor *d = (const Descriptor *) pw->datum;
+  ts_Datum args[max_args];
+  tsint result, *base;
+  int n = d->nargs, i;
+  int top = vm->sp / (int) sizeof vm->stack[0];
+  if (top + 1 < n)
+    ts_error (vm, "Stack underflow");
+  base = vm->stack + top + 1 - n;
+  for (i = 0; i < n; ++i)
+    args[i] = base[i];
+  if (0 != d->pointers)
+    for (i = 0; i < n; ++i)
+      if (d->pointers & (1 << i))
+        args[i] = (ts_Datum) ts_data_byte (vm, base[i]);
+  vm->sp -= n * sizeof vm->stack[0];
+  d->stub (d->fn, args, &result);
+  if (d->returns)
+    ts_push (vm, result);
+}
+
+/* Add a word named `name' to vm's dictionary that calls fn, a C
+   function of the type given by signature (see above).  Like
+   ts_install(), the name is not copied. */
+void
+ts_install_foreign (ts_VM *vm, char *name, void (*fn)(void),
+                    const char *signature)
+{
+  const char *colon = strchr (signature, ':');
+  int entry, i, pointers = 0;
+  Descriptor *d;
+  if (NULL == colon
+      || strspn (signature, "ipd") != (size_t) (colon - signature)
+      || 1 != strlen (colon + 1) || NULL == strchr ("idv", colon[1])
+      || -1 == (entry = find_stub (signature)))
+    ts_error (vm, "Unsupported foreign signature: %s", signature);
+  for (i = 0; signature + i < colon; ++i)
+    if ('p' == signature[i])
+      pointers |= 1 << i;
+  d = malloc (sizeof *d);
+  if (NULL == d)
+    ts_error (vm, "Out of memory");
+  d->fn = fn;
+  d->stub = entries[entry].stub;
+  d->nargs = colon - signature;
+  d->pointers = pointers;
+  d->returns = 'v' != colon[1];
+  {
+    ts_TRY (vm, frame)
+      {
+        ts_install (vm, name, ts_run_foreign, (ts_Datum) d);
+        ts_POP_TRY (vm, frame);
+      }
+    ts_EXCEPT (vm, frame)
+      {
+        free (d);
+        ts_escape (vm, frame.complaint);
+      }
+  }
+}
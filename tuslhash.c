@@ -0,0 +1,348 @@
+/* TUSL -- the ultimate scripting language.
+   Copyright 2003-2005 Darius Bacon under the terms of the MIT X license
+   found at http://www.opensource.org/licenses/mit-license.html */
+
+/* Hash tables living in data space, keyed either by cells or by
+   strings in data space (compared by contents, but not copied -- the
+   key strings must stay put while they're in the table).
+
+   A table is a header of 4 cells: the index of its slots, their
+   number (a power of 2), the number in use, and a flag for string
+   keys.  Each slot is 3 cells: the key's hash with the top bit set
+   (0 if the slot is empty), the key, and the value.  We probe
+   linearly and delete by shifting the rest of the run back, so there
+   are no tombstones.  The slots come from the heap; when the table
+   gets 3/4 full they move to a new block twice the size.
+
+   Since a script can store anything into a table, every word checks
+   the header before trusting it, and no probe goes around the slots
+   more than once. */
+
+#include <string.h>
+
+#include "tusl.h"
+
+enum { header_cells = 4, slot_cells = 3 };
+enum { h_slots, h_capacity, h_count, h_strings };
+enum { s_hash, s_key, s_value };
+
+static const tsuint used_bit = (tsuint) 1 << (8 * sizeof (tsuint) - 1);
+
+/* Mix the bits of x thoroughly. */
+static INLINE tsuint
+mix (tsuint x)
+{
+#ifdef TS_CELL32
+  x ^= x >> 16;
+  x *= 0x85ebca6bU;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35U;
+  x ^= x >> 16;
+#else
+  x ^= x >> 31;
+  x *= (tsuint) 0x7fb5d329728ea185ULL;
+  x ^= x >> 27;
+  x *= (tsuint) 0x81dadef4bc2dd44dULL;
+  x ^= x >> 33;
+#endif
+  return x;
+}
+
+/* Hash the n bytes at s, a word at a time. */
+static tsuint
+hash_bytes (const char *s, size_t n)
+{
+  tsuint h = n, w;
+  while (sizeof w <= n)
+    {
+      memcpy (&w, s, sizeof w);
+      h = mix (h ^ w);
+      s += sizeof w, n -= sizeof w;
+    }
+  w = 0;
+  memcpy (&w, s, n);
+  return mix (h ^ w);
+}
+
+/* Return a native pointer to the string at data index i, making sure
+   it ends within the data area. */
+static const char *
+data_string (ts_VM *vm, tsint i, size_t *length)
+{
+  const char *s = ts_data_byte (vm, i);
+  const char *end = memchr (s, '\0', ts_data_size - i);
+  if (NULL == end)
+    ts_error (vm, "Unterminated string");
+  *length = end - s;
+  return s;
+}
+
+/* The most slots that could fit in data space */
+static const tsint max_capacity = ts_data_size / (slot_cells * sizeof (tsint));
+
+static tsint *
+slots (ts_VM *vm, const tsint *h)
+{
+  return (tsint *) ts_data_range (vm, h[h_slots],
+                                  h[h_capacity] * slot_cells * sizeof (tsint));
+}
+
+/* Return a native pointer to table's header, after making sure its
+   capacity is a power of 2 and its slots lie within data space. */
+static tsint *
+header (ts_VM *vm, tsint table)
+{
+  tsint *h = (tsint *) ts_data_range (vm, table, 
+                                      header_cells * sizeof (tsint));
+  tsint capacity = h[h_capacity];
+  if (capacity <= 0 || max_capacity < capacity 
+      || 0 != (capacity & (capacity - 1)))
+    ts_error (vm, "Not a hash table: %ld", (long) table);
+  slots (vm, h);
+  return h;
+}
+
+static tsuint
+hash_key (ts_VM *vm, const tsint *h, tsint key)
+{
+  if (h[h_strings])
+    {
+      size_t n;
+      const char *s = data_string (vm, key, &n);
+      return hash_bytes (s, n) | used_bit;
+    }
+  return mix (key) | used_bit;
+}
+
+static int
+same_key (ts_VM *vm, const tsint *h, tsint key, tsint other)
+{
+  return key == other
+    || (h[h_strings]
+        && 0 == strncmp (ts_data_byte (vm, key), ts_data_byte (vm, other),
+                         ts_data_size - other));
+}
+
+/* Return the index of the slot holding key, or else -1. */
+static tsint
+find (ts_VM *vm, const tsint *h, const tsint *s, tsint key, tsuint hash)
+{
+  tsuint mask = h[h_capacity] - 1, i = hash & mask, probes;
+  for (probes = 0; probes <= mask; ++probes, i = (i + 1) & mask)
+    {
+      const tsint *slot = s + i * slot_cells;
+      if (0 == slot[s_hash])
+        return -1;
+      if ((tsuint) slot[s_hash] == hash && same_key (vm, h, key, slot[s_key]))
+        return i;
+    }
+  return -1;
+}
+
+/* Store a new key/value in the first free slot of its run. */
+static void
+place (ts_VM *vm, tsint *s, tsuint mask, tsuint hash, tsint key, 
+       tsint value)
+{
+  tsuint i = hash & mask, probes = 0;
+  while (0 != s[i * slot_cells + s_hash])
+    {
+      if (mask < ++probes)
+        ts_error (vm, "Hash table has no free slot");
+      i = (i + 1) & mask;
+    }
+  s[i * slot_cells + s_hash] = hash;
+  s[i * slot_cells + s_key] = key;
+  s[i * slot_cells + s_value] = value;
+}
+
+/* Allocate and clear capacity slots, returning their index. */
+static tsint
+make_slots (ts_VM *vm, tsint capacity)
+{
+  int size = capacity * slot_cells * sizeof (tsint);
+  int index = ts_allocate (vm, size);
+  memset (ts_data_range (vm, index, size), 0, size);
+  return index;
+}
+
+/* Move h's entries to slots twice as many. */
+static void
+grow (ts_VM *vm, tsint *h)
+{
+  tsint capacity = 2 * h[h_capacity];
+  tsint *old = slots (vm, h), *new;
+  tsint i, index;
+  if (max_capacity < capacity)
+    ts_error (vm, "Hash table too big");
+  index = make_slots (vm, capacity);
+  new = (tsint *) ts_data_byte (vm, index);
+  for (i = 0; i < h[h_capacity]; ++i)
+    {
+      tsint *slot = old + i * slot_cells;
+      if (0 != slot[s_hash])
+        place (vm, new, capacity - 1, slot[s_hash], slot[s_key],
+               slot[s_value]);
+    }
+  ts_free (vm, h[h_slots]);
+  h[h_slots] = index;
+  h[h_capacity] = capacity;
+}
+
+/* Make a table for about n entries and return its index. */
+static tsint
+make_table (ts_VM *vm, tsint n, int strings)
+{
+  tsint capacity = 8, table;
+  tsint *h;
+  if (n < 0 || ts_data_size < n)
+    ts_error (vm, "Bad hash table size: %ld", (long) n);
+  while (capacity * 3 / 4 < n)
+    capacity *= 2;
+  table = ts_reserve (vm, header_cells * sizeof (tsint));
+  h = (tsint *) ts_data_range (vm, table, header_cells * sizeof (tsint));
+  h[h_slots] = 0, h[h_capacity] = 0;
+  h[h_count] = 0;
+  h[h_strings] = strings;
+  h[h_slots] = make_slots (vm, capacity);
+  h[h_capacity] = capacity;
+  return table;
+}
+
+/* ( n -- table ) A table of cell keys with room for about n. */
+static void
+hash_table (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_1 (vm, n);
+  tsint table = make_table (vm, n, 0);
+  ts_OUTPUT_1 (table);
+}
+
+/* ( n -- table ) A table of string keys with room for about n. */
+static void
+string_hash_table (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_1 (vm, n);
+  tsint table = make_table (vm, n, 1);
+  ts_OUTPUT_1 (table);
+}
+
+/* ( value key table -- ) */
+static void
+hash_put (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, value, key, table);
+  tsint *h = header (vm, table);
+  tsuint hash = hash_key (vm, h, key);
+  tsint i = find (vm, h, slots (vm, h), key, hash);
+  ts_OUTPUT_0 ();
+  if (0 <= i)
+    slots (vm, h)[i * slot_cells + s_value] = value;
+  else
+    {
+      if (h[h_capacity] * 3 / 4 <= h[h_count])
+        grow (vm, h);
+      place (vm, slots (vm, h), h[h_capacity] - 1, hash, key, value);
+      ++h[h_count];
+    }
+}
+
+/* ( key table -- value flag ) The value is 0 if key isn't there. */
+static void
+hash_get (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, key, table);
+  tsint *h = header (vm, table), *s = slots (vm, h);
+  tsint i = find (vm, h, s, key, hash_key (vm, h, key));
+  if (i < 0)
+    ts_OUTPUT_2 (0, 0);
+  else
+    ts_OUTPUT_2 (s[i * slot_cells + s_value], -1);
+}
+
+/* ( key table -- flag ) Remove key, saying whether it was there. */
+static void
+hash_delete (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, key, table);
+  tsint *h = header (vm, table), *s = slots (vm, h);
+  tsint i = find (vm, h, s, key, hash_key (vm, h, key));
+  ts_OUTPUT_1 (-(0 <= i));
+  if (0 <= i)
+    {
+      tsuint mask = h[h_capacity] - 1, hole = i, j = i, probes;
+      /* Pull back any later entry of the run that may move into the
+         hole without passing its home slot. */
+      for (probes = 0; probes < mask; ++probes)
+        {
+          tsint *slot;
+          j = (j + 1) & mask;
+          slot = s + j * slot_cells;
+          if (0 == slot[s_hash])
+            break;
+          if (((j - (slot[s_hash] & mask)) & mask)
+              >= ((j - hole) & mask))
+            {
+              memcpy (s + hole * slot_cells, slot,
+                      slot_cells * sizeof (tsint));
+              hole = j;
+            }
+        }
+      s[hole * slot_cells + s_hash] = 0;
+      --h[h_count];
+    }
+}
+
+/* ( table -- n ) The number of entries. */
+static void
+hash_count (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_1 (vm, table);
+  ts_OUTPUT_1 (header (vm, table)[h_count]);
+}
+
+/* ( word table -- ) Call word ( key value -- ) on each entry, in no
+   particular order.  The word mustn't add to or delete from table. */
+static void
+hash_each (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, word, table);
+  tsint *h = header (vm, table);
+  tsint i;
+  ts_OUTPUT_0 ();
+  for (i = 0; i < h[h_capacity]; ++i)
+    {
+      tsint *slot = slots (vm, header (vm, table)) + i * slot_cells;
+      if (0 != slot[s_hash])
+        {
+          const char *complaint =
+            ts_call (vm, word, slot + s_key, 2, NULL, 0);
+          if (NULL != complaint)
+            ts_escape (vm, complaint);
+        }
+    }
+}
+
+/* ( addr -- u ) Hash the string at addr. */
+static void
+string_hash (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_1 (vm, addr);
+  size_t n;
+  const char *s = data_string (vm, addr, &n);
+  ts_OUTPUT_1 (hash_bytes (s, n));
+}
+
+/* Add the hash-table words to vm's dictionary. */
+void
+ts_install_hash_words (ts_VM *vm)
+{
+  ts_install (vm, "hash-table",        hash_table, 0);
+  ts_install (vm, "string-hash-table", string_hash_table, 0);
+  ts_install (vm, "hash-put",          hash_put, 0);
+  ts_install (vm, "hash-get",          hash_get, 0);
+  ts_install (vm, "hash-delete",       hash_delete, 0);
+  ts_install (vm, "hash-count",        hash_count, 0);
+  ts_install (vm, "hash-each",         hash_each, 0);
+  ts_install (vm, "string-hash",       string_hash, 0);
+}
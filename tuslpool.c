@@ -0,0 +1,779 @@
+/* TUSL -- the ultimate scripting language.
+   Copyright 2003-2005 Darius Bacon under the terms of the MIT X license
+   found at http://www.opensource.org/licenses/mit-license.html */
+
+/* A pool of worker threads, each running its own clone of a VM.
+   No code is shared between workers: each clone is a full private
+   copy of its original's ts_VM, so it has its own dictionary and its
+   own data area holding the compiled code.  That costs a copy per
+   worker, but lets a worker define, forget and store into its own
+   code without affecting the others.
+
+   Thread-safety notes on tusl.c, which this depends on:
+   - Nearly all interpreter state lives in the ts_VM, so distinct VMs
+     may run on distinct threads without any locking.  A single VM
+     must not be used by two threads at once.  The exceptions, all
+     unsynchronized and so for the main thread only:
+     - tusl.c's die_fn and die_data, set by ts_on_die().
+     - tuslprof.c's sampled_profile, the one profile the SIGPROF
+       handler samples, and sorting_profile, which ts_profile_report()
+       hands to its qsort() comparison.  (The profiler words refuse
+       to run in a clone.)
+   - Word names given to ts_install() are shared, not copied, by
+     ts_vm_clone(); they're never written, so that's fine.  They're
+     the only part of the dictionary the clones have in common.
+   - Error messages get formatted into the erring VM's own data space.
+   - ts_die() calls exit(), taking the whole process down.  It's only
+     reached when an error has no handler; the pool runs every job
+     under one.
+   - Clones share their original's FILE *s.  stdio locks each call,
+     so output from different workers may interleave but won't be
+     corrupted.  The 'repl' word reads stdin and doesn't belong in a
+     worker.
+   - strerror() (used on I/O errors) isn't guaranteed reentrant; the
+     worst case is a garbled complaint. */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tusl.h"
+
+/* A request to run a word on some worker */
+typedef struct Job {
+  int word;                     /* Dictionary index of the word to run */
+  tsint arg;                    /* Pushed on the stack before running */
+} Job;
+
+struct ts_Pool {
+  int nthreads;
+  ts_VM **vms;                  /* Each worker's private VM */
+  pthread_t *threads;
+  pthread_mutex_t lock;         /* Guards everything below */
+  pthread_cond_t work_ready;    /* Signaled when jobs get queued */
+  pthread_cond_t all_done;      /* Signaled when pending drops to 0 */
+  Job *jobs;                    /* Circular queue of waiting jobs */
+  int jobs_size;                /* Allocated length of jobs[] */
+  int head;                     /* Index of the next job to take */
+  int count;                    /* # of jobs in the queue */
+  int pending;                  /* # of jobs queued or running */
+  int failures;                 /* # of jobs that raised an error */
+  int quitting;                 /* Set when workers should exit */
+};
+
+typedef struct Worker_arg {
+  ts_Pool *pool;
+  int index;
+} Worker_arg;
+
+/* Run one job on vm, returning 0 on success or 1 if it raised an
+   error.  The stack is left empty either way. */
+static int
+run_job (ts_VM *vm, const Job *job)
+{
+  int failed = 0;
+  ts_TRY (vm, frame)
+    {
+      ts_push (vm, job->arg);
+      ts_run (vm, job->word);
+      ts_POP_TRY (vm, frame);
+    }
+  ts_EXCEPT (vm, frame)
+    {
+      failed = 1;
+    }
+  vm->sp = -((int) sizeof vm->stack[0]);
+  return failed;
+}
+
+static void *
+worker (void *p)
+{
+  Worker_arg *arg = p;
+  ts_Pool *pool = arg->pool;
+  ts_VM *vm = pool->vms[arg->index];
+  free (arg);
+
+  pthread_mutex_lock (&pool->lock);
+  for (;;)
+    {
+      Job job;
+      int failed;
+      while (0 == pool->count && !pool->quitting)
+        pthread_cond_wait (&pool->work_ready, &pool->lock);
+      if (0 == pool->count)
+        break;
+      job = pool->jobs[pool->head];
+      pool->head = (pool->head + 1) % pool->jobs_size;
+      --(pool->count);
+      pthread_mutex_unlock (&pool->lock);
+
+      failed = run_job (vm, &job);
+
+      pthread_mutex_lock (&pool->lock);
+      pool->failures += failed;
+      if (0 == --(pool->pending))
+        pthread_cond_broadcast (&pool->all_done);
+    }
+  pthread_mutex_unlock (&pool->lock);
+  return NULL;
+}
+
+/* Stop and reclaim the first n workers' threads and VMs. */
+static void
+stop_workers (ts_Pool *pool, int nthreads, int nvms)
+{
+  int i;
+  pthread_mutex_lock (&pool->lock);
+  pool->quitting = 1;
+  pthread_cond_broadcast (&pool->work_ready);
+  pthread_mutex_unlock (&pool->lock);
+  for (i = 0; i < nthreads; ++i)
+    pthread_join (pool->threads[i], NULL);
+  for (i = 0; i < nvms; ++i)
+    ts_vm_unmake (pool->vms[i]);
+}
+
+/* Return a new pool of nthreads workers, each with its own clone of
+   original (code, dictionary and all), or NULL if we run out of memory or threads.  Original
+   should be fully loaded first; it isn't touched by the pool
+   afterwards, and remains yours. */
+ts_Pool *
+ts_pool_make (ts_VM *original, int nthreads)
+{
+  ts_Pool *pool = calloc (1, sizeof *pool);
+  int i;
+  if (NULL == pool)
+    return NULL;
+  pool->nthreads = nthreads;
+  pool->vms = calloc (nthreads, sizeof pool->vms[0]);
+  pool->threads = calloc (nthreads, sizeof pool->threads[0]);
+  pool->jobs_size = 64;
+  pool->jobs = malloc (pool->jobs_size * sizeof pool->jobs[0]);
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->work_ready, NULL);
+  pthread_cond_init (&pool->all_done, NULL);
+  if (NULL == pool->vms || NULL == pool->threads || NULL == pool->jobs)
+    goto fail;
+
+  for (i = 0; i < nthreads; ++i)
+    if (NULL == (pool->vms[i] = ts_vm_clone (original)))
+      {
+        stop_workers (pool, 0, i);
+        goto fail;
+      }
+  for (i = 0; i < nthreads; ++i)
+    {
+      Worker_arg *arg = malloc (sizeof *arg);
+      if (NULL != arg)
+        {
+          arg->pool = pool, arg->index = i;
+          if (0 == pthread_create (&pool->threads[i], NULL, worker, arg))
+            continue;
+          free (arg);
+        }
+      stop_workers (pool, i, nthreads);
+      goto fail;
+    }
+  return pool;
+
+ fail:
+  pthread_cond_destroy (&pool->all_done);
+  pthread_cond_destroy (&pool->work_ready);
+  pthread_mutex_destroy (&pool->lock);
+  free (pool->jobs);
+  free (pool->threads);
+  free (pool->vms);
+  free (pool);
+  return NULL;
+}
+
+/* Wait for all queued jobs to finish, then reclaim pool. */
+void
+ts_pool_unmake (ts_Pool *pool)
+{
+  ts_pool_wait (pool);
+  stop_workers (pool, pool->nthreads, pool->nthreads);
+  pthread_cond_destroy (&pool->all_done);
+  pthread_cond_destroy (&pool->work_ready);
+  pthread_mutex_destroy (&pool->lock);
+  free (pool->jobs);
+  free (pool->threads);
+  free (pool->vms);
+  free (pool);
+}
+
+/* Return the number of worker threads in pool. */
+int
+ts_pool_size (ts_Pool *pool)
+{
+  return pool->nthreads;
+}
+
+/* Return worker i's VM.  Only poke at it while the pool is idle
+   (e.g. right after ts_pool_wait()). */
+ts_VM *
+ts_pool_vm (ts_Pool *pool, int i)
+{
+  return pool->vms[i];
+}
+
+/* Queue a job to push arg and run word on whichever worker is free
+   next.  Word is a dictionary index in original (and so in every
+   clone).  Return 0 on success, or -1 if out of memory. */
+int
+ts_pool_submit (ts_Pool *pool, int word, tsint arg)
+{
+  pthread_mutex_lock (&pool->lock);
+  if (pool->count == pool->jobs_size)
+    {
+      int n = pool->jobs_size;
+      Job *jobs = malloc (2 * n * sizeof jobs[0]);
+      int i;
+      if (NULL == jobs)
+        {
+          pthread_mutex_unlock (&pool->lock);
+          return -1;
+        }
+      for (i = 0; i < n; ++i)
+        jobs[i] = pool->jobs[(pool->head + i) % n];
+      free (pool->jobs);
+      pool->jobs = jobs;
+      pool->jobs_size = 2 * n;
+      pool->head = 0;
+    }
+  {
+    Job *job = pool->jobs + (pool->head + pool->count) % pool->jobs_size;
+    job->word = word;
+    job->arg = arg;
+  }
+  ++(pool->count);
+  ++(pool->pending);
+  pthread_cond_signal (&pool->work_ready);
+  pthread_mutex_unlock (&pool->lock);
+  return 0;
+}
+
+/* Wait until every job submitted so far has finished.  Return how
+   many of them raised an error (and reset that count). */
+int
+ts_pool_wait (ts_Pool *pool)
+{
+  int failures;
+  pthread_mutex_lock (&pool->lock);
+  while (0 < pool->pending)
+    pthread_cond_wait (&pool->all_done, &pool->lock);
+  failures = pool->failures;
+  pool->failures = 0;
+  pthread_mutex_unlock (&pool->lock);
+  return failures;
+}
+
+
+/* Parallel loops.  ts_par_for() runs a word once for each index in a
+   range, spread over worker threads, each with its own fresh clone of
+   the VM.  Index i owns the stride bytes of data space at base + i *
+   stride; when all the workers are done, each index's bytes get
+   copied from its worker's clone back into the original VM.  Any
+   other changes the workers make are thrown away. */
+
+typedef struct Par_loop Par_loop;
+
+typedef struct Par_worker {
+  Par_loop *loop;
+  ts_VM *vm;
+  int index;
+  pthread_t thread;
+  char complaint[128];          /* Why this worker stopped, if it failed */
+} Par_worker;
+
+struct Par_loop {
+  int word, n, chunk, nchunks;
+  int flags;
+  int nthreads;
+  pthread_mutex_t lock;         /* Guards next_chunk and failed */
+  int next_chunk;               /* The next chunk up for grabs */
+  int failed;                   /* Set to stop everyone early */
+  int *owner;                   /* Which worker ran each chunk */
+  Par_worker *workers;
+};
+
+/* Return the next chunk for worker w to run, or -1 if there are no
+   more.  In static mode the chunks are dealt out round-robin ahead of
+   time, so the same worker always gets the same chunks; otherwise
+   it's first come, first served, so fast workers pick up the slack
+   from slow ones. */
+static int
+grab_chunk (Par_worker *w, int *nth)
+{
+  Par_loop *loop = w->loop;
+  int c;
+  pthread_mutex_lock (&loop->lock);
+  if (loop->failed)
+    c = -1;
+  else if (loop->flags & ts_par_static)
+    c = w->index + (*nth)++ * loop->nthreads;
+  else
+    c = loop->next_chunk++;
+  pthread_mutex_unlock (&loop->lock);
+  return c < loop->nchunks ? c : -1;
+}
+
+static void *
+par_worker (void *p)
+{
+  Par_worker *w = p;
+  Par_loop *loop = w->loop;
+  ts_VM *vm = w->vm;
+  int sp = vm->sp, nth = 0, c;
+  while (0 <= (c = grab_chunk (w, &nth)))
+    {
+      int i = c * loop->chunk;
+      int end = i + loop->chunk < loop->n ? i + loop->chunk : loop->n;
+      loop->owner[c] = w->index;
+      ts_TRY (vm, frame)
+        {
+          for (; i < end; ++i)
+            {
+              ts_push (vm, i);
+              ts_run (vm, loop->word);
+              vm->sp = sp;
+            }
+          ts_POP_TRY (vm, frame);
+        }
+      ts_EXCEPT (vm, frame)
+        {
+          strncpy (w->complaint, frame.complaint, sizeof w->complaint - 1);
+          pthread_mutex_lock (&loop->lock);
+          loop->failed = 1;
+          pthread_mutex_unlock (&loop->lock);
+          break;
+        }
+    }
+  return NULL;
+}
+
+/* Run word on each index from 0 to n-1 (pushed on the stack first),
+   as described above, using nthreads worker threads (or one per CPU
+   if 0).  flags may include ts_par_static to make the assignment of
+   indices to workers independent of timing.  If any run raises an
+   error, raise it here after everyone's stopped; no results are
+   copied back in that case. */
+void
+ts_par_for (ts_VM *vm, int word, int n, int base, int stride,
+            int nthreads, int flags)
+{
+  Par_loop loop;
+  int i, started = 0;
+  const char *trouble = NULL;
+
+  if (n <= 0)
+    return;
+  if (stride < 0 || base < 0 || ts_data_size < base
+      || (0 < stride && (ts_data_size - base) / stride < n))
+    ts_error (vm, "par-for range out of bounds");
+  if (nthreads <= 0)
+    nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+  if (n < nthreads)
+    nthreads = n;
+
+  loop.word = word;
+  loop.n = n;
+  loop.flags = flags;
+  loop.nthreads = nthreads;
+  loop.chunk = n / (8 * nthreads);
+  if (loop.chunk < 1)
+    loop.chunk = 1;
+  loop.nchunks = (n + loop.chunk - 1) / loop.chunk;
+  loop.next_chunk = 0;
+  loop.failed = 0;
+  loop.owner = malloc (loop.nchunks * sizeof loop.owner[0]);
+  loop.workers = calloc (nthreads, sizeof loop.workers[0]);
+  pthread_mutex_init (&loop.lock, NULL);
+  if (NULL == loop.owner || NULL == loop.workers)
+    trouble = "Out of memory for par-for";
+
+  for (; NULL == trouble && started < nthreads; ++started)
+    {
+      Par_worker *w = loop.workers + started;
+      w->loop = &loop;
+      w->index = started;
+      w->vm = ts_vm_clone (vm);
+      if (NULL == w->vm)
+        trouble = "Out of memory for par-for";
+      else if (0 != pthread_create (&w->thread, NULL, par_worker, w))
+        {
+          ts_vm_unmake (w->vm);
+          trouble = "Couldn't start par-for thread";
+        }
+      if (NULL != trouble)
+        {
+          pthread_mutex_lock (&loop.lock);
+          loop.failed = 1;
+          pthread_mutex_unlock (&loop.lock);
+          break;
+        }
+    }
+
+  for (i = 0; i < started; ++i)
+    {
+      pthread_join (loop.workers[i].thread, NULL);
+      if (NULL == trouble && '\0' != loop.workers[i].complaint[0])
+        trouble = loop.workers[i].complaint;
+    }
+  if (NULL == trouble && 0 < stride)
+    for (i = 0; i < loop.nchunks; ++i)
+      {
+        int start = base + i * loop.chunk * stride;
+        int size = (i + 1 < loop.nchunks ? loop.chunk : n - i * loop.chunk);
+        memcpy (vm->data + start, 
+                loop.workers[loop.owner[i]].vm->data + start,
+                size * stride);
+      }
+
+  /* Copy the complaint out before its worker goes away. */
+  {
+    char complaint[128];
+    if (NULL != trouble)
+      {
+        strncpy (complaint, trouble, sizeof complaint - 1);
+        complaint[sizeof complaint - 1] = '\0';
+      }
+    for (i = 0; i < started; ++i)
+      ts_vm_unmake (loop.workers[i].vm);
+    pthread_mutex_destroy (&loop.lock);
+    free (loop.workers);
+    free (loop.owner);
+    if (NULL != trouble)
+      ts_error (vm, "%s", complaint);
+  }
+}
+
+static void
+do_par_for (ts_VM *vm, int flags, ts_Word *pw)
+{
+  ts_INPUT_4 (vm, base, stride, n, word);
+  ts_OUTPUT_0 ();
+  ts_par_for (vm, word, n, base, stride, pw->datum, flags);
+}
+
+/* par-for ( base stride n word -- ) */
+static void
+ts_do_par_for (ts_VM *vm, ts_Word *pw)
+{
+  do_par_for (vm, 0, pw);
+}
+
+/* par-for-static ( base stride n word -- ), the deterministic one */
+static void
+ts_do_par_for_static (ts_VM *vm, ts_Word *pw)
+{
+  do_par_for (vm, ts_par_static, pw);
+}
+
+/* Add the parallel-loop words to vm, to use nthreads threads apiece
+   (or one per CPU if 0). */
+void
+ts_install_parallel_words (ts_VM *vm, int nthreads)
+{
+  ts_install (vm, "par-for",        ts_do_par_for, nthreads);
+  ts_install (vm, "par-for-static", ts_do_par_for_static, nthreads);
+}
+
+
+/* Channels: bounded ring buffers for passing messages between VMs on
+   different threads, without locks.  A message is a cell plus up to
+   max_bytes bytes of payload, which get copied into the channel's
+   slot on sending and out into the receiver's data area on
+   receiving.  A plain channel allows one sender and one receiver at
+   a time; with ts_chan_multi_producer, any number of each (using
+   Dmitry Vyukov's bounded queue, where each slot carries a sequence
+   number saying whose turn it is). */
+
+typedef struct Slot {
+  atomic_size_t seq;            /* Multi-producer mode only */
+  tsint value;
+  int size;                     /* # of bytes of payload */
+} Slot;
+
+struct ts_Channel {
+  atomic_size_t head;           /* The next slot to receive from */
+  char pad1[64];                /* Keep head and tail on separate lines */
+  atomic_size_t tail;           /* The next slot to send into */
+  char pad2[64];
+  size_t mask;                  /* # of slots minus 1 */
+  int max_bytes;
+  int flags;
+  Slot *slots;
+  char *bytes;                  /* Slot i's payload is at i * max_bytes */
+};
+
+/* Return a new channel with room for at least capacity messages of up
+   to max_bytes bytes of payload each, or NULL if out of memory. */
+ts_Channel *
+ts_channel_make (int capacity, int max_bytes, int flags)
+{
+  ts_Channel *chan = calloc (1, sizeof *chan);
+  size_t n = 1, i;
+  if (NULL == chan)
+    return NULL;
+  while (n < (size_t) capacity)
+    n <<= 1;
+  chan->mask = n - 1;
+  chan->max_bytes = max_bytes;
+  chan->flags = flags;
+  chan->slots = calloc (n, sizeof chan->slots[0]);
+  chan->bytes = malloc (n * max_bytes + 1);
+  if (NULL == chan->slots || NULL == chan->bytes)
+    {
+      ts_channel_unmake (chan);
+      return NULL;
+    }
+  for (i = 0; i < n; ++i)
+    atomic_init (&chan->slots[i].seq, i);
+  atomic_init (&chan->head, 0);
+  atomic_init (&chan->tail, 0);
+  return chan;
+}
+
+void
+ts_channel_unmake (ts_Channel *chan)
+{
+  free (chan->bytes);
+  free (chan->slots);
+  free (chan);
+}
+
+static void
+fill_slot (ts_Channel *chan, size_t pos, tsint value, 
+           const char *bytes, int size)
+{
+  Slot *slot = chan->slots + (pos & chan->mask);
+  slot->value = value;
+  slot->size = size;
+  if (0 < size)
+    memcpy (chan->bytes + (pos & chan->mask) * chan->max_bytes, bytes, size);
+}
+
+/* Copy out the slot's message; *size comes in as the room at bytes. */
+static void
+empty_slot (ts_Channel *chan, size_t pos, tsint *value, 
+            char *bytes, int *size)
+{
+  Slot *slot = chan->slots + (pos & chan->mask);
+  int n = slot->size < *size ? slot->size : *size;
+  *value = slot->value;
+  if (0 < n)
+    memcpy (bytes, chan->bytes + (pos & chan->mask) * chan->max_bytes, n);
+  *size = slot->size;
+}
+
+/* Send a message if there's room, returning 1 if sent or 0 if full.
+   Only the first max_bytes bytes of payload get sent. */
+int
+ts_channel_try_send (ts_Channel *chan, tsint value, 
+                     const char *bytes, int size)
+{
+  size_t pos;
+  if (chan->max_bytes < size)
+    size = chan->max_bytes;
+  if (!(chan->flags & ts_chan_multi_producer))
+    {
+      pos = atomic_load_explicit (&chan->tail, memory_order_relaxed);
+      if (pos - atomic_load_explicit (&chan->head, memory_order_acquire)
+          > chan->mask)
+        return 0;
+      fill_slot (chan, pos, value, bytes, size);
+      atomic_store_explicit (&chan->tail, pos + 1, memory_order_release);
+      return 1;
+    }
+  pos = atomic_load_explicit (&chan->tail, memory_order_relaxed);
+  for (;;)
+    {
+      Slot *slot = chan->slots + (pos & chan->mask);
+      size_t seq = atomic_load_explicit (&slot->seq, memory_order_acquire);
+      if (seq == pos)
+        {
+          if (atomic_compare_exchange_weak_explicit (&chan->tail, &pos,
+                                                     pos + 1,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed))
+            break;
+        }
+      else if ((ptrdiff_t) (seq - pos) < 0)
+        return 0;
+      else
+        pos = atomic_load_explicit (&chan->tail, memory_order_relaxed);
+    }
+  fill_slot (chan, pos, value, bytes, size);
+  atomic_store_explicit (&chan->slots[pos & chan->mask].seq, pos + 1,
+                         memory_order_release);
+  return 1;
+}
+
+/* Receive a message if there is one, returning 1 if received or 0 if
+   empty.  Up to *size bytes of payload get copied to bytes; *size is
+   set to the payload's full size. */
+int
+ts_channel_try_recv (ts_Channel *chan, tsint *value, char *bytes, int *size)
+{
+  size_t pos;
+  if (!(chan->flags & ts_chan_multi_producer))
+    {
+      pos = atomic_load_explicit (&chan->head, memory_order_relaxed);
+      if (pos == atomic_load_explicit (&chan->tail, memory_order_acquire))
+        return 0;
+      empty_slot (chan, pos, value, bytes, size);
+      atomic_store_explicit (&chan->head, pos + 1, memory_order_release);
+      return 1;
+    }
+  pos = atomic_load_explicit (&chan->head, memory_order_relaxed);
+  for (;;)
+    {
+      Slot *slot = chan->slots + (pos & chan->mask);
+      size_t seq = atomic_load_explicit (&slot->seq, memory_order_acquire);
+      if (seq == pos + 1)
+        {
+          if (atomic_compare_exchange_weak_explicit (&chan->head, &pos,
+                                                     pos + 1,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed))
+            break;
+        }
+      else if ((ptrdiff_t) (seq - (pos + 1)) < 0)
+        return 0;
+      else
+        pos = atomic_load_explicit (&chan->head, memory_order_relaxed);
+    }
+  empty_slot (chan, pos, value, bytes, size);
+  atomic_store_explicit (&chan->slots[pos & chan->mask].seq, 
+                         pos + chan->mask + 1, memory_order_release);
+  return 1;
+}
+
+/* Wait a little before trying again: first just give up the CPU,
+   then start sleeping so an idle receiver doesn't burn it. */
+static void
+back_off (int *tries)
+{
+  if (++*tries < 100)
+    sched_yield ();
+  else
+    {
+      struct timespec ts = { 0, 50 * 1000 };
+      nanosleep (&ts, NULL);
+    }
+}
+
+/* Send a message, waiting for room if need be. */
+void
+ts_channel_send (ts_Channel *chan, tsint value, const char *bytes, int size)
+{
+  int tries = 0;
+  while (!ts_channel_try_send (chan, value, bytes, size))
+    back_off (&tries);
+}
+
+/* Receive a message, waiting for one if need be. */
+void
+ts_channel_recv (ts_Channel *chan, tsint *value, char *bytes, int *size)
+{
+  int tries = 0;
+  int room = *size;
+  while (*size = room, !ts_channel_try_recv (chan, value, bytes, size))
+    back_off (&tries);
+}
+
+/* The behavior of a channel's word: push its own index, which is how
+   channels get named on the stack. */
+static void
+do_channel (ts_VM *vm, ts_Word *pw)
+{
+  ts_push (vm, pw - vm->words);
+}
+
+/* Add a word named name to vm that stands for chan.  Clones of vm
+   share the channel, so it can connect them. */
+void
+ts_install_channel (ts_VM *vm, char *name, ts_Channel *chan)
+{
+  ts_install (vm, name, do_channel, (ts_Datum) chan);
+}
+
+/* Return the channel named by the word at index z. */
+static ts_Channel *
+get_channel (ts_VM *vm, tsint z)
+{
+  if ((size_t) z >= (size_t) vm->where || do_channel != vm->words[z].action)
+    ts_error (vm, "Not a channel: %d", (int) z);
+  return (ts_Channel *) vm->words[z].datum;
+}
+
+/* chan-send ( value chan -- ) */
+static void
+ts_chan_send (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_2 (vm, y, z);
+  ts_OUTPUT_0 ();
+  ts_channel_send (get_channel (vm, z), y, NULL, 0);
+}
+
+/* chan-recv ( chan -- value ) */
+static void
+ts_chan_recv (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_1 (vm, z);
+  tsint value;
+  int size = 0;
+  ts_channel_recv (get_channel (vm, z), &value, NULL, &size);
+  ts_OUTPUT_1 (value);
+}
+
+/* chan-try-recv ( chan -- value flag ), with value 0 if none */
+static void
+ts_chan_try_recv (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_1 (vm, z);
+  tsint value = 0;
+  int size = 0;
+  int got = ts_channel_try_recv (get_channel (vm, z), &value, NULL, &size);
+  ts_OUTPUT_2 (got ? value : 0, -got);
+}
+
+/* chan-send-bytes ( addr u chan -- ) */
+static void
+ts_chan_send_bytes (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, x, y, z);
+  ts_OUTPUT_0 ();
+  ts_channel_send (get_channel (vm, z), y, ts_data_range (vm, x, y), y);
+}
+
+/* chan-recv-bytes ( addr u chan -- u' ): receive up to u bytes of
+   payload into addr, giving the size that was sent. */
+static void
+ts_chan_recv_bytes (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_3 (vm, x, y, z);
+  tsint value;
+  int size = y;
+  ts_channel_recv (get_channel (vm, z), &value, ts_data_range (vm, x, y),
+                   &size);
+  ts_OUTPUT_1 (size);
+}
+
+/* Add the channel words to vm. */
+void
+ts_install_channel_words (ts_VM *vm)
+{
+  ts_install (vm, "chan-send",       ts_chan_send, 0);
+  ts_install (vm, "chan-recv",       ts_chan_recv, 0);
+  ts_install (vm, "chan-try-recv",   ts_chan_try_recv, 0);
+  ts_install (vm, "chan-send-bytes", ts_chan_send_bytes, 0);
+  ts_install (vm, "chan-recv-bytes", ts_chan_recv_bytes, 0);
+}
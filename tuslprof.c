@@ -0,0 +1,358 @@
+/* TUSL -- the ultimate scripting language.
+   Copyright 2003-2005 Darius Bacon under the terms of the MIT X license
+   found at http://www.opensource.org/licenses/mit-license.html */
+
+/* A profiler for colon definitions.  It hooks the VM's colon tracers
+   to count calls and time each word, self and inclusive, and keeps a
+   shadow call stack that a profiling timer samples, for flame
+   graphs.  Only one profile at a time can take samples. */
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "tusl.h"
+
+enum {
+  max_depth = 1024,             /* Deepest shadow stack we track */
+  sample_depth = 64,            /* Deepest sampled stack we record */
+  max_samples = 20000,
+  sample_usec = 1000            /* Sampling interval */
+};
+
+typedef struct Frame {
+  int word;
+  uint64_t start;               /* When it was entered, in ns */
+  uint64_t children;            /* Time spent in its callees so far */
+} Frame;
+
+typedef struct Sample {
+  short depth;
+  short words[sample_depth];    /* Outermost first */
+} Sample;
+
+struct ts_Profile {
+  ts_VM *vm;
+  int running;
+  uint64_t calls[ts_dictionary_size];
+  uint64_t self[ts_dictionary_size];      /* ns */
+  uint64_t inclusive[ts_dictionary_size]; /* ns, outermost calls only */
+  int active[ts_dictionary_size];         /* # of activations on stack */
+  Frame stack[max_depth];
+  volatile int depth;           /* May exceed max_depth; we just stop
+                                   tracking frames past there */
+  Sample *samples;
+  volatile int nsamples;
+  ts_CTraceFn *saved_tracer;    /* The colon tracers we took over, */
+  void *saved_tracer_data;      /* to put back when we stop */
+  ts_CTraceFn *saved_exit_tracer;
+};
+
+static ts_Profile *volatile sampled_profile = NULL;
+
+static uint64_t
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Return pw's dictionary index, or -1 if it's not in the dictionary
+   (like the phony words run by ;will). */
+static int
+word_index (ts_VM *vm, ts_Word *pw)
+{
+  size_t i = pw - vm->words;
+  return i < (size_t) vm->where ? (int) i : -1;
+}
+
+static int
+enter (ts_VM *vm, ts_Word *pw)
+{
+  ts_Profile *prof = vm->colon_tracer_data;
+  int w = word_index (vm, pw), d = prof->depth;
+  if (d < max_depth)
+    {
+      prof->stack[d].word = w;
+      prof->stack[d].children = 0;
+      prof->stack[d].start = now ();
+    }
+  if (0 <= w)
+    ++(prof->calls[w]), ++(prof->active[w]);
+  prof->depth = d + 1;
+  return 0;
+}
+
+static int
+leave (ts_VM *vm, ts_Word *pw)
+{
+  ts_Profile *prof = vm->colon_tracer_data;
+  int d = prof->depth - 1;
+  if (d < 0)
+    return 0;                   /* Entered before profiling started */
+  prof->depth = d;
+  if (d < max_depth)
+    {
+      Frame *f = prof->stack + d;
+      uint64_t elapsed = now () - f->start;
+      if (0 <= f->word)
+        {
+          prof->self[f->word] += elapsed - f->children;
+          if (0 == --(prof->active[f->word]))
+            prof->inclusive[f->word] += elapsed;
+        }
+      if (0 < d)
+        prof->stack[d - 1].children += elapsed;
+    }
+  return 0;
+}
+
+/* The profiling timer's signal handler: record the shadow stack. */
+static void
+take_sample (int signum)
+{
+  ts_Profile *prof = sampled_profile;
+  if (NULL != prof && prof->nsamples < max_samples && 0 < prof->depth)
+    {
+      Sample *s = prof->samples + prof->nsamples;
+      int i, d = prof->depth < max_depth ? prof->depth : max_depth;
+      int skip = d < sample_depth ? 0 : d - sample_depth;
+      s->depth = d - skip;
+      for (i = 0; i < s->depth; ++i)
+        s->words[i] = prof->stack[skip + i].word;
+      prof->nsamples = prof->nsamples + 1;
+    }
+}
+
+static void
+set_timer (int usec)
+{
+  struct itimerval it;
+  it.it_interval.tv_sec = 0;
+  it.it_interval.tv_usec = usec;
+  it.it_value = it.it_interval;
+  setitimer (ITIMER_PROF, &it, NULL);
+}
+
+/* Start (or continue) profiling, taking over vm's colon tracers
+   until we stop.  Whatever colon tracers were there don't run in the
+   meantime. */
+void
+ts_profile_start (ts_Profile *prof)
+{
+  ts_VM *vm = prof->vm;
+  if (prof->running)
+    return;
+  prof->running = 1;
+  prof->depth = 0;
+  prof->saved_tracer = vm->colon_tracer;
+  prof->saved_tracer_data = vm->colon_tracer_data;
+  prof->saved_exit_tracer = vm->colon_exit_tracer;
+  vm->colon_tracer = enter;
+  vm->colon_tracer_data = prof;
+  vm->colon_exit_tracer = leave;
+  if (NULL == sampled_profile)
+    {
+      struct sigaction sa;
+      memset (&sa, 0, sizeof sa);
+      sa.sa_handler = take_sample;
+      sa.sa_flags = SA_RESTART;
+      sigaction (SIGPROF, &sa, NULL);
+      sampled_profile = prof;
+      set_timer (sample_usec);
+    }
+}
+
+/* Stop profiling, keeping what's been gathered so far, and give
+   back the colon tracers we took over (unless someone else has taken
+   them over from us since). */
+void
+ts_profile_stop (ts_Profile *prof)
+{
+  ts_VM *vm = prof->vm;
+  if (!prof->running)
+    return;
+  prof->running = 0;
+  if (sampled_profile == prof)
+    {
+      set_timer (0);
+      sampled_profile = NULL;
+    }
+  if (enter == vm->colon_tracer && prof == vm->colon_tracer_data)
+    {
+      vm->colon_tracer = prof->saved_tracer;
+      vm->colon_tracer_data = prof->saved_tracer_data;
+      vm->colon_exit_tracer = prof->saved_exit_tracer;
+    }
+}
+
+/* Forget everything gathered so far. */
+void
+ts_profile_reset (ts_Profile *prof)
+{
+  memset (prof->calls, 0, sizeof prof->calls);
+  memset (prof->self, 0, sizeof prof->self);
+  memset (prof->inclusive, 0, sizeof prof->inclusive);
+  memset (prof->active, 0, sizeof prof->active);
+  prof->nsamples = 0;
+}
+
+static const ts_Profile *sorting_profile;
+
+static int
+compare_self (const void *a, const void *b)
+{
+  uint64_t x = sorting_profile->self[*(const int *) a];
+  uint64_t y = sorting_profile->self[*(const int *) b];
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void
+put_line (ts_VM *vm, const char *line)
+{
+  ts_put_string (vm, line, strlen (line));
+}
+
+/* Print a table of the words called, busiest first, to vm's output. */
+void
+ts_profile_report (ts_Profile *prof)
+{
+  ts_VM *vm = prof->vm;
+  int order[ts_dictionary_size];
+  int i, n = 0;
+  char line[160];
+  for (i = 0; i < vm->where; ++i)
+    if (0 < prof->calls[i])
+      order[n++] = i;
+  sorting_profile = prof;
+  qsort (order, n, sizeof order[0], compare_self);
+  put_line (vm, "       calls     self ms    total ms  word\n");
+  for (i = 0; i < n; ++i)
+    {
+      int w = order[i];
+      snprintf (line, sizeof line, "%12llu %11.3f %11.3f  %s\n",
+                (unsigned long long) prof->calls[w],
+                prof->self[w] / 1e6, prof->inclusive[w] / 1e6,
+                NULL != vm->words[w].name ? vm->words[w].name : "?");
+      put_line (vm, line);
+    }
+}
+
+static int
+compare_samples (const void *a, const void *b)
+{
+  const Sample *s = a, *t = b;
+  int i;
+  for (i = 0; i < s->depth && i < t->depth; ++i)
+    if (s->words[i] != t->words[i])
+      return s->words[i] - t->words[i];
+  return s->depth - t->depth;
+}
+
+/* Write the sampled call stacks to vm's output in the collapsed
+   format that flamegraph.pl and friends read: one line per distinct
+   stack, callers first, separated by semicolons, then a count. */
+void
+ts_profile_write_collapsed (ts_Profile *prof)
+{
+  ts_VM *vm = prof->vm;
+  int n = prof->nsamples, i = 0;
+  qsort (prof->samples, n, sizeof prof->samples[0], compare_samples);
+  while (i < n)
+    {
+      int j, count = 1;
+      char line[32];
+      while (i + count < n
+             && 0 == compare_samples (prof->samples + i,
+                                      prof->samples + i + count))
+        ++count;
+      for (j = 0; j < prof->samples[i].depth; ++j)
+        {
+          int w = prof->samples[i].words[j];
+          const char *name = 0 <= w && w < vm->where ? vm->words[w].name : NULL;
+          if (0 < j)
+            ts_put_char (vm, ';');
+          put_line (vm, NULL != name ? name : "?");
+        }
+      snprintf (line, sizeof line, " %d\n", count);
+      put_line (vm, line);
+      i += count;
+    }
+}
+
+/* Return the profile behind a profiler word, which must belong to
+   vm rather than to a VM it was cloned from. */
+static ts_Profile *
+owned_profile (ts_VM *vm, ts_Word *pw)
+{
+  ts_Profile *prof = (ts_Profile *) pw->datum;
+  if (vm != prof->vm)
+    ts_error (vm, "%s: profile belongs to another VM", pw->name);
+  return prof;
+}
+
+static void
+do_profile_start (ts_VM *vm, ts_Word *pw)
+{
+  ts_profile_start (owned_profile (vm, pw));
+}
+
+static void
+do_profile_stop (ts_VM *vm, ts_Word *pw)
+{
+  ts_profile_stop (owned_profile (vm, pw));
+}
+
+static void
+do_profile_reset (ts_VM *vm, ts_Word *pw)
+{
+  ts_profile_reset (owned_profile (vm, pw));
+}
+
+static void
+do_profile_report (ts_VM *vm, ts_Word *pw)
+{
+  ts_profile_report (owned_profile (vm, pw));
+}
+
+static void
+do_profile_collapsed (ts_VM *vm, ts_Word *pw)
+{
+  ts_profile_write_collapsed (owned_profile (vm, pw));
+}
+
+/* Make a profile for vm and add the words to control it.  Return the
+   profile, or NULL if out of memory; reclaim it with
+   ts_profile_unmake() before vm. */
+ts_Profile *
+ts_install_profiler_words (ts_VM *vm)
+{
+  ts_Profile *prof = calloc (1, sizeof *prof);
+  if (NULL == prof)
+    return NULL;
+  prof->samples = malloc (max_samples * sizeof prof->samples[0]);
+  if (NULL == prof->samples)
+    {
+      free (prof);
+      return NULL;
+    }
+  prof->vm = vm;
+  ts_install (vm, "profile-start",     do_profile_start, (ts_Datum) prof);
+  ts_install (vm, "profile-stop",      do_profile_stop, (ts_Datum) prof);
+  ts_install (vm, "profile-reset",     do_profile_reset, (ts_Datum) prof);
+  ts_install (vm, "profile-report",    do_profile_report, (ts_Datum) prof);
+  ts_install (vm, "profile-collapsed", do_profile_collapsed, (ts_Datum) prof);
+  return prof;
+}
+
+void
+ts_profile_unmake (ts_Profile *prof)
+{
+  ts_profile_stop (prof);
+  free (prof->samples);
+  free (prof);
+}
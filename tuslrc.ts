@@ -26,11 +26,11 @@
 
 :c,                     here c!  1 allot ;
 
-:if                     '<<branch>> ,  here  0 , ;
-:then {addr}            here addr ! ;
+:if                     '<<branch>> compile,  here  0 compile, ;
+:then                   resolve ;
 
-:unless                 if '; , then ;
-:when                   '0= , unless ;
+:unless                 if '; compile, then ;
+:when                   '0= compile, unless ;
 
 :for-range {i n w}      i n < (when)  i w execute  i 1+ n w for-range ;
 :for {n w}              0 n w for-range ;
@@ -160,7 +160,7 @@
 :2variable              here constant  2, ;
 
 :2literal {x y}         x literal  y literal ;
-:2constant              2literal  '; , ;
+:2constant              2literal  '; compile, ;
 
 
 \ Extras I practically never use, it turns out
@@ -168,5 +168,5 @@
 :over {x y}             x y x ;
 :rot {x y z}            y z x ;
 
-:&&                     '0= , if 'false , '; , then ;
-:||                     if 'true , '; , then ;
+:&&                     '0= compile, if 'false compile, '; compile, then ;
+:||                     if 'true compile, '; compile, then ;
@@ -0,0 +1,628 @@
+/* TUSL -- the ultimate scripting language.
+   Copyright 2003-2005 Darius Bacon under the terms of the MIT X license
+   found at http://www.opensource.org/licenses/mit-license.html */
+
+/* Cooperative tasks within one VM.  Each task runs a word on its own
+   C stack (which is where the interpreter keeps return addresses and
+   locals), with its own data stack, exception handlers, and I/O
+   streams; the dictionary and data area are shared.  Switching tasks
+   copies the live part of the data stack in and out of vm->stack,
+   which is cheap as long as stacks stay shallow, as they usually do.
+
+   Tasks may also do I/O on non-blocking file descriptors: a read or
+   write that would block suspends the task until epoll says the fd
+   is ready, and ts_run_tasks() drives them all. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "tusl.h"
+
+enum { default_c_stack_size = 64 * 1024 };
+
+/* The parts of a VM that belong to whichever task is running */
+typedef struct Context {
+  tsint *cells;                 /* Saved contents of vm->stack */
+  int capacity;                 /* Allocated length of cells[] */
+  int sp;
+  ts_Code *pc;
+  ts_Handler_frame *handler_stack;
+  int depth;
+  ts_Stream input;
+  ts_Stream output;
+} Context;
+
+typedef enum { task_ready, task_running, task_done } Task_state;
+
+typedef struct Task {
+  Task_state state;
+  int word;                     /* What the task runs */
+  int resumer;                  /* The task that resumed us, or -1 */
+  int waiting_fd;               /* The fd we're blocked on, or -1 */
+  unsigned waiting_events;      /* What we're waiting on it for */
+  char *c_stack;                /* mmap'd, with a guard page at the bottom */
+  ucontext_t context;           /* Where to pick up this task */
+  ucontext_t caller;            /* Where to return to on yield */
+  Context own;                  /* This task's VM state while it's out */
+  Context callers;              /* The resumer's VM state while we're in */
+  char complaint[128];          /* Why the task died, if it did */
+  int next_free;                /* The next finished task to reuse, or -1 */
+} Task;
+
+/* A file descriptor hooked up to a stream */
+typedef struct Port {
+  ts_Tasks *tasks;
+  int fd;
+  struct Port *next;
+} Port;
+
+struct ts_Tasks {
+  ts_VM *vm;
+  size_t c_stack_size;
+  int epoll_fd;                 /* For waiting on blocked tasks' fds */
+  int nwaiting;                 /* # of tasks blocked on fds */
+  Port *ports;                  /* All the ports made, for reclaiming */
+  Task **tasks;                 /* Individually allocated: a suspended
+                                   ucontext_t mustn't move */
+  int ntasks;
+  int capacity;
+  int current;                  /* Index of the running task, or -1 */
+  int free_task;                /* A finished task to reuse, or -1 */
+};
+
+/* Copy vm's running state into ctx. */
+static void
+save (ts_VM *vm, Context *ctx)
+{
+  int n = vm->sp / (int) sizeof vm->stack[0] + 1;
+  if (ctx->capacity < n)
+    {
+      tsint *cells = realloc (ctx->cells, n * sizeof cells[0]);
+      if (NULL == cells)
+        ts_die ("Out of memory saving a task's stack");
+      ctx->cells = cells;
+      ctx->capacity = n;
+    }
+  memcpy (ctx->cells, vm->stack, n * sizeof vm->stack[0]);
+  ctx->sp = vm->sp;
+  ctx->pc = vm->pc;
+  ctx->handler_stack = vm->handler_stack;
+  ctx->depth = vm->depth;
+  ctx->input = vm->input;
+  ctx->output = vm->output;
+}
+
+/* Make ctx vm's running state. */
+static void
+restore (ts_VM *vm, const Context *ctx)
+{
+  int n = ctx->sp / (int) sizeof vm->stack[0] + 1;
+  memcpy (vm->stack, ctx->cells, n * sizeof vm->stack[0]);
+  vm->sp = ctx->sp;
+  vm->pc = ctx->pc;
+  vm->handler_stack = ctx->handler_stack;
+  vm->depth = ctx->depth;
+  vm->input = ctx->input;
+  vm->output = ctx->output;
+}
+
+static void
+release_c_stack (ts_Tasks *tasks, Task *t)
+{
+  if (NULL != t->c_stack)
+    munmap (t->c_stack, tasks->c_stack_size);
+  t->c_stack = NULL;
+}
+
+/* Return a task with a C stack that's not in use, along with its
+   index: a finished one if there is one, else a new one. */
+static Task *
+get_free_task (ts_Tasks *tasks, int *index)
+{
+  ts_VM *vm = tasks->vm;
+  Task *t;
+  char *c_stack;
+  size_t page = sysconf (_SC_PAGESIZE);
+
+  if (0 <= tasks->free_task)
+    {
+      *index = tasks->free_task;
+      t = tasks->tasks[*index];
+      tasks->free_task = t->next_free;
+      return t;
+    }
+  if (tasks->ntasks == tasks->capacity)
+    {
+      int n = tasks->capacity ? 2 * tasks->capacity : 16;
+      Task **grown = realloc (tasks->tasks, n * sizeof grown[0]);
+      if (NULL == grown)
+        ts_error (vm, "Out of memory for tasks");
+      tasks->tasks = grown;
+      tasks->capacity = n;
+    }
+  c_stack = mmap (NULL, tasks->c_stack_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == c_stack)
+    ts_error (vm, "Out of memory for tasks");
+  if (0 != mprotect (c_stack, page, PROT_NONE))
+    {
+      int err = errno;
+      munmap (c_stack, tasks->c_stack_size);
+      ts_error (vm, "Can't guard a task's stack: %s", strerror (err));
+    }
+  t = calloc (1, sizeof *t);
+  if (NULL == t)
+    {
+      munmap (c_stack, tasks->c_stack_size);
+      ts_error (vm, "Out of memory for tasks");
+    }
+  t->c_stack = c_stack;
+  *index = tasks->ntasks;
+  tasks->tasks[tasks->ntasks++] = t;
+  return t;
+}
+
+/* The bottom of every task's C stack.  (makecontext() only passes
+   ints, so the pointer comes in halves.) */
+static void
+task_main (unsigned hi, unsigned lo)
+{
+  ts_Tasks *tasks = (ts_Tasks *) (((uintptr_t) hi << 16 << 16) | lo);
+  ts_VM *vm = tasks->vm;
+  Task *t = tasks->tasks[tasks->current];
+  {
+    ts_TRY (vm, frame)
+      {
+        ts_run (vm, t->word);
+        if (vm->output.buffer < vm->output.ptr)
+          ts_flush_output (vm);
+        ts_POP_TRY (vm, frame);
+      }
+    ts_EXCEPT (vm, frame)
+      {
+        strncpy (t->complaint, frame.complaint, sizeof t->complaint - 1);
+      }
+  }
+  t->state = task_done;
+  restore (vm, &t->callers);
+  setcontext (&t->caller);
+}
+
+/* Return a new task that will run word when first resumed.  It
+   starts with the I/O streams of whoever spawned it, minus anything
+   they had buffered.  The number of a task that has finished, and
+   been seen to finish by its resumer, may get reused. */
+int
+ts_spawn (ts_Tasks *tasks, int word)
+{
+  ts_VM *vm = tasks->vm;
+  int index;
+  Task *t = get_free_task (tasks, &index);
+  t->state = task_ready;
+  t->word = word;
+  t->resumer = -1;
+  t->waiting_fd = -1;
+  t->waiting_events = 0;
+  t->complaint[0] = '\0';
+  t->next_free = -1;
+  /* A reused task still has the state it last yielded with. */
+  t->own.sp = -((int) sizeof vm->stack[0]);
+  t->own.pc = NULL;
+  t->own.handler_stack = NULL;
+  t->own.depth = 0;
+  ts_set_stream (&t->own.input, vm->input.streamer, vm->input.data,
+                 vm->input.place.opt_filename);
+  ts_set_stream (&t->own.output, vm->output.streamer, vm->output.data,
+                 vm->output.place.opt_filename);
+  /* These get used from inside vm, not from where they sit now. */
+  t->own.input.ptr = t->own.input.limit = vm->input.buffer;
+  t->own.output.ptr = t->own.output.limit = vm->output.buffer;
+  getcontext (&t->context);
+  t->context.uc_stack.ss_sp = t->c_stack;
+  t->context.uc_stack.ss_size = tasks->c_stack_size;
+  t->context.uc_link = NULL;
+  makecontext (&t->context, (void (*)(void)) task_main, 2,
+               (unsigned) ((uintptr_t) tasks >> 16 >> 16),
+               (unsigned) (uintptr_t) tasks);
+  return index;
+}
+
+static Task *
+get_task (ts_Tasks *tasks, tsint task)
+{
+  if ((size_t) task >= (size_t) tasks->ntasks)
+    ts_error (tasks->vm, "No such task: %d", (int) task);
+  return tasks->tasks[task];
+}
+
+/* Run task until it yields or finishes.  If it dies of an error,
+   re-raise the error here. */
+void
+ts_resume (ts_Tasks *tasks, int task)
+{
+  ts_VM *vm = tasks->vm;
+  Task *t = get_task (tasks, task);
+  if (task_ready != t->state)
+    ts_error (vm, "Task %d is not suspended", task);
+  if (0 <= t->waiting_fd)
+    ts_error (vm, "Task %d is waiting on I/O", task);
+
+  save (vm, &t->callers);
+  restore (vm, &t->own);
+  t->resumer = tasks->current;
+  t->state = task_running;
+  tasks->current = task;
+  swapcontext (&t->caller, &t->context);
+  tasks->current = t->resumer;
+
+  if (task_done == t->state)
+    {
+      t->next_free = tasks->free_task;
+      tasks->free_task = task;
+      if ('\0' != t->complaint[0])
+        ts_error (vm, "%s", t->complaint);
+    }
+}
+
+/* Suspend the running task, returning control to whoever resumed it. */
+void
+ts_yield (ts_Tasks *tasks)
+{
+  ts_VM *vm = tasks->vm;
+  Task *t;
+  if (tasks->current < 0)
+    ts_error (vm, "yield outside of any task");
+  t = tasks->tasks[tasks->current];
+  save (vm, &t->own);
+  restore (vm, &t->callers);
+  t->state = task_ready;
+  swapcontext (&t->context, &t->caller);
+}
+
+/* Return true iff task has run to completion. */
+int
+ts_task_done (ts_Tasks *tasks, int task)
+{
+  return task_done == get_task (tasks, task)->state;
+}
+
+/* Return the index of the running task, or -1 if none. */
+int
+ts_current_task (ts_Tasks *tasks)
+{
+  return tasks->current;
+}
+
+
+/* Non-blocking I/O */
+
+/* Return the events that tasks are waiting on fd for, or 0 if none. */
+static unsigned
+interest_in (ts_Tasks *tasks, int fd)
+{
+  unsigned events = 0;
+  int i;
+  for (i = 0; i < tasks->ntasks; ++i)
+    if (fd == tasks->tasks[i]->waiting_fd)
+      events |= tasks->tasks[i]->waiting_events;
+  return events;
+}
+
+/* Tell epoll what tasks are now waiting on fd for, given what they
+   were waiting for before. */
+static int
+update_interest (ts_Tasks *tasks, int fd, unsigned before)
+{
+  struct epoll_event event;
+  event.events = interest_in (tasks, fd);
+  event.data.fd = fd;
+  if (before == event.events)
+    return 0;
+  else if (0 == event.events)
+    return epoll_ctl (tasks->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  else
+    return epoll_ctl (tasks->epoll_fd, 0 == before ? EPOLL_CTL_ADD 
+                                                   : EPOLL_CTL_MOD,
+                      fd, &event);
+}
+
+/* Suspend the running task until fd is ready for events.  Outside of
+   any task, there's nothing else to do, so just block.  Any number of
+   tasks may wait on the same fd, e.g. a reader and a writer sharing a
+   socket. */
+static void
+wait_for (ts_Tasks *tasks, int fd, unsigned events)
+{
+  if (tasks->current < 0)
+    {
+      struct pollfd p;
+      p.fd = fd;
+      p.events = EPOLLIN == events ? POLLIN : POLLOUT;
+      poll (&p, 1, -1);
+    }
+  else
+    {
+      Task *t = tasks->tasks[tasks->current];
+      unsigned before = interest_in (tasks, fd);
+      t->waiting_fd = fd;
+      t->waiting_events = events;
+      if (0 != update_interest (tasks, fd, before))
+        {
+          int err = errno;
+          t->waiting_fd = -1;
+          ts_error (tasks->vm, "Can't wait on fd %d: %s", fd, strerror (err));
+        }
+      ++(tasks->nwaiting);
+      ts_yield (tasks);
+    }
+}
+
+/* A ts_Streamer that reads from a non-blocking fd. */
+static int
+read_from_fd (ts_VM *vm)
+{
+  ts_Stream *input = &vm->input;
+  Port *port = (Port *) input->data;
+  for (;;)
+    {
+      int n = read (port->fd, input->buffer, sizeof input->buffer);
+      if (0 <= n)
+        return n;
+      if (EAGAIN == errno || EWOULDBLOCK == errno)
+        wait_for (port->tasks, port->fd, EPOLLIN);
+      else if (EINTR != errno)
+        ts_error (vm, "Read error: %s", strerror (errno));
+    }
+}
+
+/* A ts_Streamer that writes to a non-blocking fd. */
+static int
+write_to_fd (ts_VM *vm)
+{
+  ts_Stream *output = &vm->output;
+  Port *port = (Port *) output->data;
+  int n = output->ptr - output->buffer;
+  int done = 0;
+  while (done < n)
+    {
+      int m = write (port->fd, output->buffer + done, n - done);
+      if (0 <= m)
+        done += m;
+      else if (EAGAIN == errno || EWOULDBLOCK == errno)
+        wait_for (port->tasks, port->fd, EPOLLOUT);
+      else if (EINTR != errno)
+        ts_error (vm, "Write error: %s", strerror (errno));
+    }
+  return n;
+}
+
+static Port *
+make_port (ts_Tasks *tasks, int fd)
+{
+  Port *port = malloc (sizeof *port);
+  if (NULL == port)
+    ts_error (tasks->vm, "Out of memory");
+  fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+  port->tasks = tasks;
+  port->fd = fd;
+  port->next = tasks->ports;
+  tasks->ports = port;
+  return port;
+}
+
+/* Set the running task's input (or the VM's, outside of any task) to
+   come from fd, which gets put into non-blocking mode. */
+void
+ts_set_input_fd (ts_Tasks *tasks, int fd)
+{
+  ts_set_stream (&tasks->vm->input, read_from_fd, make_port (tasks, fd), NULL);
+}
+
+/* Set the running task's output to go to fd, likewise. */
+void
+ts_set_output_fd (ts_Tasks *tasks, int fd)
+{
+  ts_set_stream (&tasks->vm->output, write_to_fd, make_port (tasks, fd), NULL);
+}
+
+/* Wake up the tasks whose fds are ready, waiting up to timeout
+   milliseconds (or forever if -1) for at least one. */
+static void
+poll_fds (ts_Tasks *tasks, int timeout)
+{
+  struct epoll_event events[64];
+  int i, j, n = epoll_wait (tasks->epoll_fd, events, 64, timeout);
+  for (i = 0; i < n; ++i)
+    {
+      int fd = events[i].data.fd;
+      unsigned ready = events[i].events;
+      unsigned before = interest_in (tasks, fd);
+      if (0 != (ready & (EPOLLERR | EPOLLHUP)))
+        ready |= EPOLLIN | EPOLLOUT;  /* let them find out what's wrong */
+      for (j = 0; j < tasks->ntasks; ++j)
+        {
+          Task *t = tasks->tasks[j];
+          if (fd == t->waiting_fd && 0 != (ready & t->waiting_events))
+            {
+              t->waiting_fd = -1;
+              --(tasks->nwaiting);
+            }
+        }
+      update_interest (tasks, fd, before);
+    }
+}
+
+/* Resume every unfinished task in turn, over and over, until they're
+   all done; when they're all blocked on I/O, sleep till one can go.
+   A task that dies of an error gets its complaint printed. */
+void
+ts_run_tasks (ts_Tasks *tasks)
+{
+  ts_VM *vm = tasks->vm;
+  for (;;)
+    {
+      int i, ran = 0, live = 0;
+      for (i = 0; i < tasks->ntasks; ++i)
+        {
+          Task *t = tasks->tasks[i];
+          if (task_done == t->state || task_running == t->state)
+            continue;
+          ++live;
+          if (0 <= t->waiting_fd)
+            continue;
+          ++ran;
+          {
+            ts_TRY (vm, frame)
+              {
+                ts_resume (tasks, i);
+                ts_POP_TRY (vm, frame);
+              }
+            ts_EXCEPT (vm, frame)
+              {
+                ts_put_string (vm, frame.complaint, strlen (frame.complaint));
+                ts_put_char (vm, '\n');
+              }
+          }
+        }
+      if (0 == live)
+        break;
+      if (0 < tasks->nwaiting)
+        poll_fds (tasks, 0 == ran ? -1 : 0);
+    }
+}
+
+/* Return the task set behind a task word, which must belong to vm:
+   a clone that copied the word mustn't switch its original's tasks. */
+static ts_Tasks *
+owned_tasks (ts_VM *vm, ts_Word *pw)
+{
+  ts_Tasks *tasks = (ts_Tasks *) pw->datum;
+  if (vm != tasks->vm)
+    ts_error (vm, "%s: tasks belong to another VM", pw->name);
+  return tasks;
+}
+
+static void
+do_spawn (ts_VM *vm, ts_Word *pw)
+{
+  ts_Tasks *tasks = owned_tasks (vm, pw);
+  ts_INPUT_1 (vm, z);
+  int task = ts_spawn (tasks, z);
+  ts_OUTPUT_1 (task);
+}
+
+static void
+do_resume (ts_VM *vm, ts_Word *pw)
+{
+  ts_Tasks *tasks = owned_tasks (vm, pw);
+  ts_INPUT_1 (vm, z);
+  ts_OUTPUT_0 ();
+  get_task (tasks, z);
+  ts_resume (tasks, z);
+}
+
+static void
+do_yield (ts_VM *vm, ts_Word *pw)
+{
+  ts_yield (owned_tasks (vm, pw));
+}
+
+static void
+do_task_done (ts_VM *vm, ts_Word *pw)
+{
+  ts_Tasks *tasks = owned_tasks (vm, pw);
+  ts_INPUT_1 (vm, z);
+  int done = task_done == get_task (tasks, z)->state;
+  ts_OUTPUT_1 (-done);
+}
+
+static void
+do_run_tasks (ts_VM *vm, ts_Word *pw)
+{
+  ts_run_tasks (owned_tasks (vm, pw));
+}
+
+static void
+do_fd_input (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_1 (vm, z);
+  ts_OUTPUT_0 ();
+  ts_set_input_fd (owned_tasks (vm, pw), z);
+}
+
+static void
+do_fd_output (ts_VM *vm, ts_Word *pw)
+{
+  ts_INPUT_1 (vm, z);
+  ts_OUTPUT_0 ();
+  ts_set_output_fd (owned_tasks (vm, pw), z);
+}
+
+/* Set up vm for tasks, each with a C stack of c_stack_size bytes (or
+   a default size if 0), and add the task words to its dictionary.
+   Return the task set, to be reclaimed by ts_tasks_unmake() before
+   the vm is.  (A clone of vm copies the words, but they refuse to run
+   there -- install the task words after cloning instead.) */
+ts_Tasks *
+ts_install_task_words (ts_VM *vm, size_t c_stack_size)
+{
+  ts_Tasks *tasks = calloc (1, sizeof *tasks);
+  if (NULL == tasks)
+    return NULL;
+  tasks->vm = vm;
+  if (0 == c_stack_size)
+    c_stack_size = default_c_stack_size;
+  {
+    size_t page = sysconf (_SC_PAGESIZE);
+    tasks->c_stack_size = (c_stack_size + 2 * page - 1) / page * page;
+  }
+  tasks->current = -1;
+  tasks->free_task = -1;
+  tasks->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  if (tasks->epoll_fd < 0)
+    {
+      free (tasks);
+      return NULL;
+    }
+
+  ts_install (vm, "spawn",        do_spawn, (ts_Datum) tasks);
+  ts_install (vm, "resume",       do_resume, (ts_Datum) tasks);
+  ts_install (vm, "yield",        do_yield, (ts_Datum) tasks);
+  ts_install (vm, "task-done?",   do_task_done, (ts_Datum) tasks);
+  ts_install (vm, "run-tasks",    do_run_tasks, (ts_Datum) tasks);
+  ts_install (vm, "fd-input",     do_fd_input, (ts_Datum) tasks);
+  ts_install (vm, "fd-output",    do_fd_output, (ts_Datum) tasks);
+  return tasks;
+}
+
+/* Reclaim tasks, abandoning any that haven't finished. */
+void
+ts_tasks_unmake (ts_Tasks *tasks)
+{
+  int i;
+  for (i = 0; i < tasks->ntasks; ++i)
+    {
+      Task *t = tasks->tasks[i];
+      release_c_stack (tasks, t);
+      free (t->own.cells);
+      free (t->callers.cells);
+      free (t);
+    }
+  while (NULL != tasks->ports)
+    {
+      Port *next = tasks->ports->next;
+      free (tasks->ports);
+      tasks->ports = next;
+    }
+  close (tasks->epoll_fd);
+  free (tasks->tasks);
+  free (tasks);
+}
@@ -0,0 +1,216 @@
+/* TUSL -- the ultimate scripting language.
+   Copyright 2003-2005 Darius Bacon under the terms of the MIT X license
+   found at http://www.opensource.org/licenses/mit-license.html */
+
+/* A low-overhead execution trace.  Each instruction run appends a
+   fixed-size binary record to a ring buffer, overwriting the oldest;
+   the buffer gets written out on demand or when the process dies, and
+   tracedump turns a dump back into text using the dictionary names
+   saved with it.
+
+   Dump format (native byte order):
+     "TUSLTRC1"
+     u32 record size, u32 # of records, u32 # of names, u32 flags
+     the names, each a u16 length and that many bytes (no NUL)
+     the records, oldest first */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tusl.h"
+
+struct ts_Trace {
+  ts_VM *vm;
+  int running;
+  int flags;
+  ts_Trace_record *records;
+  unsigned mask;                /* # of records - 1 (a power of 2) */
+  unsigned next;                /* Total # of records ever appended */
+  char *dump_filename;
+  struct ts_Trace *next_trace;  /* The next in all_traces */
+};
+
+/* Every trace made and not yet unmade, to dump if the process dies.
+   (Like ts_on_die(), this is meant for the main thread only.) */
+static ts_Trace *all_traces = NULL;
+
+static uint64_t
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* The tracer: append a record for word. */
+static int
+record (ts_VM *vm, unsigned word)
+{
+  ts_Trace *trace = vm->tracer_data;
+  ts_Trace_record *r = trace->records + (trace->next++ & trace->mask);
+  int sp = vm->sp / (int) sizeof vm->stack[0];
+  r->word = word;
+  r->sp = sp;
+  r->pc = NULL == vm->pc ? -1 : (int) ((char *) vm->pc - vm->data);
+  r->depth = vm->depth;
+  r->top = 0 <= sp ? vm->stack[sp] : 0;
+  r->ns = (trace->flags & ts_trace_timestamps) ? now () : 0;
+  return 0;
+}
+
+void
+ts_trace_start (ts_Trace *trace)
+{
+  trace->running = 1;
+  trace->vm->tracer = record;
+  trace->vm->tracer_data = trace;
+}
+
+void
+ts_trace_stop (ts_Trace *trace)
+{
+  if (!trace->running)
+    return;
+  trace->running = 0;
+  trace->vm->tracer = NULL;
+  trace->vm->tracer_data = NULL;
+}
+
+static int
+put_u32 (FILE *fp, uint32_t u)
+{
+  return 1 == fwrite (&u, sizeof u, 1, fp);
+}
+
+/* Write the trace to the file named filename.  Return 0 on success,
+   else -1 with errno set. */
+int
+ts_trace_dump (ts_Trace *trace, const char *filename)
+{
+  ts_VM *vm = trace->vm;
+  unsigned size = trace->mask + 1;
+  unsigned n = trace->next < size ? trace->next : size;
+  unsigned i;
+  int ok;
+  FILE *fp = fopen (filename, "wb");
+  if (NULL == fp)
+    return -1;
+  ok = 1 == fwrite ("TUSLTRC1", 8, 1, fp)
+    && put_u32 (fp, sizeof trace->records[0])
+    && put_u32 (fp, n)
+    && put_u32 (fp, vm->where)
+    && put_u32 (fp, trace->flags);
+  for (i = 0; ok && i < (unsigned) vm->where; ++i)
+    {
+      const char *name = vm->words[i].name;
+      uint16_t length = NULL == name ? 0 : strlen (name);
+      ok = 1 == fwrite (&length, sizeof length, 1, fp)
+        && length == fwrite (name, 1, length, fp);
+    }
+  for (i = trace->next - n; ok && i != trace->next; ++i)
+    ok = 1 == fwrite (trace->records + (i & trace->mask),
+                      sizeof trace->records[0], 1, fp);
+  if (0 != fclose (fp) || !ok)
+    return -1;
+  return 0;
+}
+
+/* On the way out of ts_die(), leave each trace behind -- if there's
+   anything to it. */
+static void
+dump_at_death (void *data)
+{
+  ts_Trace *trace;
+  for (trace = all_traces; NULL != trace; trace = trace->next_trace)
+    if (0 != trace->next || trace->running)
+      if (0 == ts_trace_dump (trace, trace->dump_filename))
+        fprintf (stderr, "Trace written to %s\n", trace->dump_filename);
+}
+
+/* Return the trace behind a trace word, which must belong to vm
+   rather than to a VM it was cloned from. */
+static ts_Trace *
+owned_trace (ts_VM *vm, ts_Word *pw)
+{
+  ts_Trace *trace = (ts_Trace *) pw->datum;
+  if (vm != trace->vm)
+    ts_error (vm, "%s: trace belongs to another VM", pw->name);
+  return trace;
+}
+
+static void
+do_trace_start (ts_VM *vm, ts_Word *pw)
+{
+  ts_trace_start (owned_trace (vm, pw));
+}
+
+static void
+do_trace_stop (ts_VM *vm, ts_Word *pw)
+{
+  ts_trace_stop (owned_trace (vm, pw));
+}
+
+static void
+do_trace_dump (ts_VM *vm, ts_Word *pw)
+{
+  ts_Trace *trace = owned_trace (vm, pw);
+  if (0 != ts_trace_dump (trace, trace->dump_filename))
+    ts_error (vm, "Can't write trace to %s", trace->dump_filename);
+}
+
+/* Make a trace for vm holding the last nrecords instructions run
+   (rounded up to a power of 2), and add the words to control it.  It
+   gets dumped to dump_filename by trace-dump, or if the process dies
+   through ts_die() -- which includes an uncaught error -- after
+   tracing has been started.  Any number of traces may be made, each
+   with its own dump file; they share the one ts_on_die() hook.
+   Return the trace, or NULL if out of memory; reclaim it with
+   ts_trace_unmake() before vm. */
+ts_Trace *
+ts_install_trace_words (ts_VM *vm, int nrecords, int flags,
+                        const char *dump_filename)
+{
+  unsigned size = 1;
+  ts_Trace *trace = calloc (1, sizeof *trace);
+  if (NULL == trace)
+    return NULL;
+  while (size < (unsigned) nrecords)
+    size <<= 1;
+  trace->records = malloc (size * sizeof trace->records[0]);
+  trace->dump_filename = malloc (strlen (dump_filename) + 1);
+  if (NULL == trace->records || NULL == trace->dump_filename)
+    {
+      free (trace->records);
+      free (trace->dump_filename);
+      free (trace);
+      return NULL;
+    }
+  strcpy (trace->dump_filename, dump_filename);
+  trace->vm = vm;
+  trace->flags = flags;
+  trace->mask = size - 1;
+  trace->next_trace = all_traces;
+  all_traces = trace;
+  ts_on_die (dump_at_death, NULL);
+  ts_install (vm, "trace-start", do_trace_start, (ts_Datum) trace);
+  ts_install (vm, "trace-stop",  do_trace_stop, (ts_Datum) trace);
+  ts_install (vm, "trace-dump",  do_trace_dump, (ts_Datum) trace);
+  return trace;
+}
+
+void
+ts_trace_unmake (ts_Trace *trace)
+{
+  ts_Trace **p;
+  ts_trace_stop (trace);
+  for (p = &all_traces; *p != trace; p = &(*p)->next_trace)
+    ;
+  *p = trace->next_trace;
+  if (NULL == all_traces)
+    ts_cancel_on_die (dump_at_death, NULL);
+  free (trace->records);
+  free (trace->dump_filename);
+  free (trace);
+}